@@ -0,0 +1,167 @@
+#include "absprofile.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+
+using namespace std;
+namespace fs = llvm::sys::fs;
+
+namespace {
+// The path is set once before validation starts. The entries are shared by
+// the threads that validate functions in parallel.
+string profilePath;
+mutex entriesMutex;
+map<string, absprofile::Entry> entries;
+atomic<uint64_t> numHits(0), numStores(0), numInvalidated(0),
+                 numSavedIterations(0), numSavedMs(0);
+
+// Each line is "<key> <fp dot> <fp cast> <int dot> <fp add/sum> <iterations>
+// <solver ms>", where the abstraction levels are the values of the enums.
+optional<pair<string, absprofile::Entry>> parseLine(llvm::StringRef line) {
+  llvm::SmallVector<llvm::StringRef, 7> fields;
+  line.split(fields, ' ', -1, /*KeepEmpty=*/false);
+  if (fields.size() != 7)
+    return nullopt;
+
+  uint64_t values[6];
+  for (unsigned i = 0; i < 6; ++i) {
+    if (fields[i + 1].getAsInteger(10, values[i]))
+      return nullopt;
+  }
+  // A profile written by another version may have other levels
+  if (values[0] > (uint64_t)aop::AbsLevelFpDot::SUM_MUL ||
+      values[1] > (uint64_t)aop::AbsLevelFpCast::PRECISE ||
+      values[2] > (uint64_t)aop::AbsLevelIntDot::SUM_MUL ||
+      values[3] > (uint64_t)aop::AbsFpAddSumEncoding::UNROLL_TO_ADD)
+    return nullopt;
+
+  absprofile::Entry entry = {{
+      (aop::AbsLevelFpDot)values[0], (aop::AbsLevelFpCast)values[1],
+      (aop::AbsLevelIntDot)values[2], (aop::AbsFpAddSumEncoding)values[3]},
+    values[4], values[5]};
+  return make_pair(fields[0].str(), entry);
+}
+
+// Returns false if the file exists but cannot be read.
+bool load(map<string, absprofile::Entry> &to) {
+  auto buf = llvm::MemoryBuffer::getFile(profilePath);
+  if (!buf)
+    return buf.getError() == errc::no_such_file_or_directory;
+
+  llvm::StringRef text = (*buf)->getBuffer();
+  while (!text.empty()) {
+    auto [line, rest] = text.split('\n');
+    text = rest;
+    if (auto parsed = parseLine(line))
+      to.insert(std::move(*parsed));
+  }
+  return true;
+}
+
+// Merge the entries that other processes stored meanwhile, apply update, and
+// rewrite the file. Returns false if the file could not be written.
+// entriesMutex must be held.
+template<class Fn>
+bool update(Fn &&fn) {
+  map<string, absprofile::Entry> onDisk;
+  load(onDisk);
+  for (auto &[k, e]: onDisk)
+    entries.try_emplace(k, e);
+  fn(entries);
+
+  // Write to a unique temporary file and rename it to the profile, so that
+  // readers never see a partially written profile.
+  llvm::SmallString<128> model(profilePath);
+  model += ".%%%%%%%%.tmp";
+  llvm::SmallString<128> tmpPath;
+  int fd;
+  if (fs::createUniqueFile(model, fd, tmpPath))
+    return false;
+
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    for (auto &[k, e]: entries) {
+      os << k << " " << (unsigned)e.abs.fpDot << " "
+         << (unsigned)e.abs.fpCast << " " << (unsigned)e.abs.intDot << " "
+         << (unsigned)e.abs.fpAddSumEncoding << " " << e.iterations << " "
+         << e.solverMs << "\n";
+    }
+    os.close();
+    if (os.has_error()) {
+      os.clear_error();
+      fs::remove(tmpPath);
+      return false;
+    }
+  }
+
+  if (fs::rename(tmpPath, profilePath)) {
+    fs::remove(tmpPath);
+    return false;
+  }
+  return true;
+}
+}
+
+namespace absprofile {
+
+bool open(const string &path) {
+  profilePath = path;
+  lock_guard<mutex> lock(entriesMutex);
+  if (!load(entries)) {
+    profilePath.clear();
+    return false;
+  }
+  return true;
+}
+
+bool isOpen() {
+  return !profilePath.empty();
+}
+
+string makeKey(const string &desc) {
+  llvm::SHA256 hasher;
+  hasher.update(desc);
+  return llvm::toHex(hasher.final(), /*LowerCase=*/true);
+}
+
+optional<Entry> lookup(const string &key) {
+  lock_guard<mutex> lock(entriesMutex);
+  auto itr = entries.find(key);
+  if (itr == entries.end())
+    return nullopt;
+
+  numHits++;
+  numSavedIterations += itr->second.iterations;
+  numSavedMs += itr->second.solverMs;
+  return itr->second;
+}
+
+void store(const string &key, const Entry &entry) {
+  lock_guard<mutex> lock(entriesMutex);
+  if (update([&](auto &es) { es[key] = entry; }))
+    numStores++;
+}
+
+void invalidate(const string &key, const Entry &entry) {
+  lock_guard<mutex> lock(entriesMutex);
+  // The iterations of the entry were not saved after all
+  numSavedIterations -= entry.iterations;
+  numSavedMs -= entry.solverMs;
+  numInvalidated++;
+  update([&](auto &es) { es.erase(key); });
+}
+
+Stats getStats() {
+  return {numHits, numStores, numInvalidated, numSavedIterations,
+          numSavedMs};
+}
+
+} // namespace absprofile
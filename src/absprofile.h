@@ -0,0 +1,50 @@
+#pragma once
+
+#include "abstractops.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// A persistent record of the abstractions that validated functions, so that
+// a later run on a function of the same shape starts at the abstraction
+// instead of refining the most abstract one step by step again.
+// The profile is a text file that the mlir-tv processes using it share.
+namespace absprofile {
+
+struct Entry {
+  aop::Abstraction abs;
+  // The refinement iterations that failed before abs was reached, and the
+  // solver time that they took
+  uint64_t iterations;
+  uint64_t solverMs;
+};
+
+struct Stats {
+  uint64_t hits;
+  uint64_t stores;
+  uint64_t invalidated;
+  // The iterations and the solver time of the hits' entries
+  uint64_t savedIterations;
+  uint64_t savedMs;
+};
+
+// Load the profile at path. The file is created by the first store.
+// Returns false if the file exists but cannot be read.
+bool open(const std::string &path);
+bool isOpen();
+
+// The key of a function. desc must describe the shape of the function pair
+// and the options that change how the abstraction is refined.
+std::string makeKey(const std::string &desc);
+
+std::optional<Entry> lookup(const std::string &key);
+// Record entry and rewrite the file. Entries that other processes stored
+// after this process loaded the file are merged.
+void store(const std::string &key, const Entry &entry);
+// Remove the entry that lookup(key) returned because starting at it did not
+// work out, and take it out of the saved iterations and time.
+void invalidate(const std::string &key, const Entry &entry);
+
+Stats getStats();
+
+} // namespace absprofile
@@ -4,36 +4,88 @@
 #include "smt.h"
 #include "utils.h"
 #include "value.h"
+#include <functional>
 #include <map>
+#include <unordered_map>
 
 using namespace smt;
 using namespace std;
 
 namespace {
+// The abstraction state below is thread-local because it holds SMT objects
+// that belong to the calling thread's SMT context (see smt::ContextScope).
+
 string freshName(string prefix) {
-  static int count = 0;
+  static thread_local int count = 0;
   return prefix + to_string(count ++);
 }
 
-bool useMultiset;
-aop::UsedAbstractOps usedOps;
-aop::Abstraction abstraction;
+thread_local bool useMultiset;
+thread_local aop::UsedAbstractOps usedOps;
+thread_local aop::Abstraction abstraction;
 
 // ----- Constants and global vars for abstract floating point operations ------
 
-bool isFpAddAssociative;
-bool doUnrollIntSum;
-bool hasArithProperties;
-bool useConcreteFP;
-unsigned maxUnrollFpSumBound;
+thread_local bool isFpAddAssociative;
+thread_local bool doUnrollIntSum;
+thread_local bool hasArithProperties;
+thread_local bool useConcreteFP;
+thread_local unsigned maxUnrollFpSumBound;
+
+thread_local optional<aop::AbsFpEncoding> floatEnc;
+thread_local optional<aop::AbsFpEncoding> doubleEnc;
+
+// ----- Abstract ops whose encoding is deferred (see aop::setLazyEncoding) ---
+
+thread_local bool encodeLazily;
+
+struct LazyOp {
+  string name;
+  FnDecl placeholder;
+  vector<Expr> params;
+  // The arguments of the application of the placeholder
+  vector<Expr> args;
+  // Encodes the op under the current abstraction
+  function<Expr(const vector<Expr> &)> encode;
+  // If set, the op is encoded under this abstraction instead of the current
+  // one (see aop::refineLazyOps)
+  optional<aop::Abstraction> abs;
+};
+thread_local vector<LazyOp> lazyOps;
 
-optional<aop::AbsFpEncoding> floatEnc;
-optional<aop::AbsFpEncoding> doubleEnc;
+bool isSameAbstraction(const aop::Abstraction &a, const aop::Abstraction &b) {
+  return a.fpDot == b.fpDot && a.fpCast == b.fpCast && a.intDot == b.intDot &&
+      a.fpAddSumEncoding == b.fpAddSumEncoding;
+}
+
+Expr encodeLazyOp(const LazyOp &op, const vector<Expr> &params,
+    const aop::Abstraction &abs) {
+  auto prevAbs = abstraction;
+  abstraction = abs;
+  auto e = op.encode(params);
+  abstraction = prevAbs;
+  return e;
+}
+
+Expr mkLazyOp(const string &name, const Sort &range, const vector<Expr> &args,
+    function<Expr(const vector<Expr> &)> &&encode) {
+  vector<Sort> domain;
+  vector<Expr> params;
+  for (auto &arg: args) {
+    domain.push_back(arg.sort());
+    params.push_back(Expr::mkVar(arg, freshName(name + "_arg"), true));
+  }
+  auto opName = freshName(name);
+  FnDecl placeholder(domain, range, string(opName));
+  lazyOps.push_back({opName, placeholder, std::move(params), args,
+                     std::move(encode), nullopt});
+  return placeholder.apply(args);
+}
 
 // ----- Constants and global vars for abstract int operations ------
 
-map<unsigned, FnDecl> int_sumfn;
-map<unsigned, FnDecl> int_dotfn;
+thread_local map<unsigned, FnDecl> int_sumfn;
+thread_local map<unsigned, FnDecl> int_dotfn;
 
 // ----- Constants and global vars for abstract sumf operations ------
 
@@ -119,12 +171,90 @@ namespace aop {
 UsedAbstractOps getUsedAbstractOps() { return usedOps; }
 
 void clearAbstractions() {
+  encodeLazily = false;
+  lazyOps.clear();
+  clearFnDefinitions();
   floatEnc.reset();
   doubleEnc.reset();
   int_sumfn.clear();
   int_dotfn.clear();
 }
 
+void setLazyEncoding(bool lazy) {
+  encodeLazily = lazy && !isFpAddAssociative;
+}
+
+bool canReabstract(const Abstraction &abs) {
+  return encodeLazily && abs.fpCast == abstraction.fpCast;
+}
+
+void reabstract(const Abstraction &abs) {
+  assert(canReabstract(abs));
+  // The ops were refined at most up to abs
+  if (!isSameAbstraction(abs, abstraction)) {
+    for (auto &op: lazyOps)
+      op.abs.reset();
+  }
+  abstraction = abs;
+}
+
+void instantiateLazyOps() {
+  // The encodings of the ops must not be deferred again
+  bool wasLazy = encodeLazily;
+  encodeLazily = false;
+  vector<FnDefinition> defs;
+  for (auto &op: lazyOps) {
+    defs.push_back({op.placeholder, op.params,
+        encodeLazyOp(op, op.params, op.abs.value_or(abstraction))});
+  }
+  encodeLazily = wasLazy;
+
+  setFnDefinitions(std::move(defs));
+}
+
+vector<unsigned> findSpuriousLazyOps(const Model &model,
+                                     const Abstraction &abs) {
+  bool wasLazy = encodeLazily;
+  encodeLazily = false;
+  // Encoding the ops for evaluation must not change the record
+  auto prevUsedOps = usedOps;
+
+  vector<unsigned> ops;
+  for (unsigned i = 0; i < lazyOps.size(); ++i) {
+    auto &op = lazyOps[i];
+    auto opAbs = op.abs.value_or(abstraction);
+    if (isSameAbstraction(opAbs, abs))
+      continue;
+
+    auto value = model.eval(encodeLazyOp(op, op.args, opAbs), true);
+    auto refinedValue = model.eval(encodeLazyOp(op, op.args, abs), true);
+    // The value cannot be evaluated if the arguments have bound variables
+    if (!value.isNumeral() || !refinedValue.isNumeral() ||
+        !value.isIdentical(refinedValue)) {
+      verbose("findSpuriousLazyOps") << op.name << ": "
+          << or_omit(value) << " under the current abstraction, "
+          << or_omit(refinedValue) << " under the refined one\n";
+      ops.push_back(i);
+    }
+  }
+
+  usedOps = prevUsedOps;
+  encodeLazily = wasLazy;
+  return ops;
+}
+
+unsigned getNumLazyOpsToRefine(const Abstraction &abs) {
+  unsigned n = 0;
+  for (auto &op: lazyOps)
+    n += !isSameAbstraction(op.abs.value_or(abstraction), abs);
+  return n;
+}
+
+void refineLazyOps(const vector<unsigned> &ops, const Abstraction &abs) {
+  for (unsigned i: ops)
+    lazyOps[i].abs = abs;
+}
+
 void setAbstraction(
     Abstraction abs,
     bool addAssoc,
@@ -136,6 +266,9 @@ void setAbstraction(
     bool floatHasInfOrNaN,
     unsigned doubleNonConstsCnt, set<llvm::APFloat> doubleConsts,
     bool doubleHasInfOrNaN) {
+  encodeLazily = false;
+  lazyOps.clear();
+  clearFnDefinitions();
   abstraction = abs;
   doUnrollIntSum = unrollIntSum;
   maxUnrollFpSumBound = unrollFpSumBound;
@@ -997,14 +1130,48 @@ Expr AbsFpEncoding::multisetSum(const Expr &a, const Expr &n) {
 Expr AbsFpEncoding::sum(const Expr &a, const Expr &n,
     optional<vector<smt::Expr>> &&elems,
     optional<smt::Expr> &&initValue) {
+  // An identity initValue is dropped here rather than in the encoding below,
+  // so that the lazy and eager encodings build the same terms: the lazy one
+  // cannot see it in the placeholder's parameters.
+  if (initValue && (*initValue == zero(true)).isTrue())
+    initValue.reset();
+
+  if (encodeLazily) {
+    // Whether the length is constant is decided here for the same reason.
+    bool constLen = n.isNumeral(), hasInit = initValue.has_value();
+    size_t numElems = elems ? elems->size() : 0;
+
+    vector<Expr> args = {a};
+    if (!constLen)
+      args.push_back(n);
+    if (elems)
+      args.insert(args.end(), elems->begin(), elems->end());
+    if (initValue)
+      args.push_back(*initValue);
+
+    return mkLazyOp("fp_sum_" + fn_suffix, sort(), args,
+        [this, n, constLen, hasInit, hasElems = elems.has_value(), numElems]
+        (const vector<Expr> &params) {
+      size_t i = 1;
+      Expr len = constLen ? n : params[i++];
+      optional<vector<Expr>> elems;
+      if (hasElems) {
+        elems.emplace(params.begin() + i, params.begin() + i + numElems);
+        i += numElems;
+      }
+      optional<Expr> initValue;
+      if (hasInit)
+        initValue = params[i];
+      return sum(params[0], len, std::move(elems), std::move(initValue));
+    });
+  }
+
   if (getFpAddAssociativity() && !n.isNumeral())
     throw UnsupportedException(
         "Only an array of constant length is supported.");
 
   // If initValue is a non-identity value, add it to the beginning of the array.
   bool insertInitVal = initValue.has_value();
-  if (insertInitVal)
-    insertInitVal &= !((*initValue == zero(true)).isTrue());
 
   auto [arr, size] = insertInitVal ?
       insertInitialValue(a, n, *initValue) : make_pair(a, n);
@@ -1062,6 +1229,29 @@ Expr AbsFpEncoding::exp(const Expr &x) {
 
 Expr AbsFpEncoding::dot(const Expr &a, const Expr &b,
     const Expr &n, std::optional<smt::Expr> &&initValue) {
+  // See sum()
+  if (initValue && (*initValue == zero(true)).isTrue())
+    initValue.reset();
+
+  if (encodeLazily) {
+    bool constLen = n.isNumeral(), hasInit = initValue.has_value();
+
+    vector<Expr> args = {a, b};
+    if (!constLen)
+      args.push_back(n);
+    if (initValue)
+      args.push_back(*initValue);
+
+    return mkLazyOp("fp_dot_" + fn_suffix, sort(), args,
+        [this, n, constLen, hasInit](const vector<Expr> &params) {
+      Expr len = constLen ? n : params[2];
+      optional<Expr> initValue;
+      if (hasInit)
+        initValue = params.back();
+      return dot(params[0], params[1], len, std::move(initValue));
+    });
+  }
+
   if (abstraction.fpDot == AbsLevelFpDot::FULLY_ABS) {
     usedOps.fpDot = true;
     auto i = (Expr)Index::var("idx", VarType::BOUND);
@@ -1263,40 +1453,77 @@ Expr AbsFpEncoding::max(const Expr &arr0, const Expr &n0,
   return getMaxFn().apply({input});
 }
 
-Expr AbsFpEncoding::getFpAssociativePrecondition() {
+vector<Expr> AbsFpEncoding::getFpAssociativeConstraints() {
+  // Bucket the sums by their lengths, so that pairs of sums that can never be
+  // related are not enumerated.
+  map<uint64_t, vector<unsigned>> sumsByLen;
+  for (unsigned i = 0; i < fp_sums.size(); i ++)
+    sumsByLen[fp_sums[i].len].push_back(i);
+  uint64_t numPairs = (uint64_t)fp_sums.size() * (fp_sums.size() - 1) / 2;
+  uint64_t numConstrained = 0;
+
+  vector<Expr> constraints;
+  auto addConstraint = [&constraints](const Expr &e) {
+    auto c = e.simplify();
+    if (!c.isTrue())
+      constraints.push_back(std::move(c));
+  };
+
+  auto printPruning = [&]() {
+    if (numPairs == 0)
+      return;
+    verbose("getFpAssociativeConstraints") << fn_suffix << ": "
+        << numConstrained << " of " << numPairs << " pairs of sums related ("
+        << (numPairs - numConstrained) * 100 / numPairs << "% pruned)\n";
+  };
+
   if (useMultiset) {
     // precondition between `bag equality <-> assoc_sumfn`
-    Expr precond = Expr::mkBool(true);
-    for (unsigned i = 0; i < fp_sums.size(); i ++) {
-      for (unsigned j = i + 1; j < fp_sums.size(); j ++) {
-        auto [abag, aelems, alen, asum] = fp_sums[i];
-        auto [bbag, belems, blen, bsum] = fp_sums[j];
-
-        precond = precond & (abag == bbag).implies(asum == bsum);
+    // Bags of different sizes are never equal.
+    for (auto &[len, sums]: sumsByLen) {
+      for (unsigned i = 0; i < sums.size(); i ++) {
+        for (unsigned j = i + 1; j < sums.size(); j ++) {
+          auto [abag, aelems, alen, asum] = fp_sums[sums[i]];
+          auto [bbag, belems, blen, bsum] = fp_sums[sums[j]];
+
+          addConstraint((abag == bbag).implies(asum == bsum));
+          numConstrained ++;
+        }
       }
     }
+    printPruning();
 
     // precondition for bags union
     for (unsigned i = 0; i < fp_sums.size(); i ++) {
       for (unsigned j = 0; j < i; j ++) {
-        for (unsigned k = j + 1; k < i; k ++) {
-          auto [abag, aelems, alen, asum] = fp_sums[i];
-          auto [bbag, belems, blen, bsum] = fp_sums[j];
+        auto [abag, aelems, alen, asum] = fp_sums[i];
+        auto [bbag, belems, blen, bsum] = fp_sums[j];
+        if (alen < blen)
+          continue;
+
+        // The sums k with j < k < i whose length is alen - blen
+        auto itr = sumsByLen.find(alen - blen);
+        if (itr == sumsByLen.end())
+          continue;
+        for (unsigned k: itr->second) {
+          if (k <= j || k >= i)
+            continue;
           auto [cbag, celems, clen, csum] = fp_sums[k];
 
-          if (alen != blen + clen) continue;
-          auto precondition = (bbag.bagUnion(cbag) == abag)
-            .implies(add(bsum, csum) == asum);
-          precond = precond & precondition;
+          addConstraint((bbag.bagUnion(cbag) == abag)
+            .implies(add(bsum, csum) == asum));
         }
       }
     }
 
-    return precond;
+    return constraints;
   }
 
   vector<optional<Expr>> hashValues(fp_sums.size());
   auto hashfn = getHashFnForAddAssoc();
+  // The simplified sums, indexed by their hashes
+  vector<Expr> simplifiedSums;
+  unordered_multimap<size_t, unsigned> sumIndex;
 
   for (unsigned i = 0; i < fp_sums.size(); i ++) {
     const auto &[a, aelems, alen, asum] = fp_sums[i];
@@ -1306,49 +1533,68 @@ Expr AbsFpEncoding::getFpAssociativePrecondition() {
     for (unsigned j = 0; j < alen; j ++) {
       auto elem = !aelems.empty() ? aelems[j] : a.select(Index(j));
 
-      optional<Expr> current;
-      for (unsigned k = 0; k < i; k ++) {
-        const auto &[b, belems, blen, bsum] = fp_sums[k];
-        if ((bsum == elem).simplify().isTrue())
-          current = hashValues[k];
+      // If elem is the result of an earlier sum, reuse the hash of the sum.
+      // Take the latest one if there are many.
+      // The sums are first looked up by the identity of their simplified
+      // terms. The simplifier can also equate terms that it does not rewrite
+      // to the same term, so a miss falls back to checking the equality with
+      // each earlier sum.
+      auto selem = elem.simplify();
+      optional<unsigned> prev;
+      auto [begin, end] = sumIndex.equal_range(selem.hash());
+      for (auto itr = begin; itr != end; ++itr) {
+        if (simplifiedSums[itr->second].isIdentical(selem, false) &&
+            (!prev || *prev < itr->second))
+          prev = itr->second;
+      }
+      for (unsigned k = i; !prev && k > 0; --k) {
+        if ((fp_sums[k - 1].sumExpr == elem).simplify().isTrue())
+          prev = k - 1;
       }
-      aVal = aVal + current.value_or(hashfn.apply(elem));
+      aVal = aVal + (prev ? *hashValues[*prev] : hashfn.apply(elem));
     }
     hashValues[i] = aVal;
+
+    simplifiedSums.push_back(asum.simplify());
+    sumIndex.emplace(simplifiedSums.back().hash(), i);
   }
 
   // precondition between `hashfn <-> sumfn`
-  Expr precond = Expr::mkBool(true);
-  for (unsigned i = 0; i < fp_sums.size(); i ++) {
+  auto relate = [&](unsigned i, unsigned j) {
     const auto &[a, aelems, alen, asum] = fp_sums[i];
+    const auto &[b, belems, blen, bsum] = fp_sums[j];
+
+    auto aVal = *hashValues[i];
+    auto bVal = *hashValues[j];
+    // precond: sumfn(A) != sumfn(B) -> hashfn(A) != hashfn(B)
+    // This means if two summations are different, we can find concrete hash
+    // function that hashes into different value.
+    addConstraint((!(asum == bsum)).implies(!(aVal == bVal)));
+    numConstrained ++;
+  };
 
-    for (unsigned j = i + 1; j < fp_sums.size(); j ++) {
-      const auto &[b, belems, blen, bsum] = fp_sums[j];
-
-      // if addf, sumfn are repective, we only consider same length array
-      if (abstraction.fpAddSumEncoding == AbsFpAddSumEncoding::DEFAULT &&
-          alen != blen)
-        continue;
-
-      auto aVal = *hashValues[i];
-      auto bVal = *hashValues[j];
-      // precond: sumfn(A) != sumfn(B) -> hashfn(A) != hashfn(B)
-      // This means if two summations are different, we can find concrete hash
-      // function that hashes into different value.
-      auto associativity = (!(asum == bsum)).implies(!(aVal == bVal));
-      precond = precond & associativity;
+  // if addf, sumfn are repective, we only consider same length array
+  if (abstraction.fpAddSumEncoding == AbsFpAddSumEncoding::DEFAULT) {
+    for (auto &[len, sums]: sumsByLen) {
+      for (unsigned i = 0; i < sums.size(); i ++)
+        for (unsigned j = i + 1; j < sums.size(); j ++)
+          relate(sums[i], sums[j]);
     }
+  } else {
+    for (unsigned i = 0; i < fp_sums.size(); i ++)
+      for (unsigned j = i + 1; j < fp_sums.size(); j ++)
+        relate(i, j);
   }
+  printPruning();
 
   // To support summation without identity equals to orginal one
   //   sum([a])=sum([a, 0, 0])
   // add a precondition for hash(-0) = 0
   auto fpAddIdentity = zero(true);
   auto hashIdentity = Expr::mkBV(0, getHashRangeBits());
-  precond = precond & (hashfn.apply(fpAddIdentity) == hashIdentity);
+  addConstraint(hashfn.apply(fpAddIdentity) == hashIdentity);
 
-  precond = precond.simplify();
-  return precond;
+  return constraints;
 }
 
 Expr AbsFpEncoding::getFpTruncatePrecondition(aop::AbsFpEncoding &tgt) {
@@ -1449,16 +1695,27 @@ Expr AbsFpEncoding::getFpConstantPrecondition() {
   return precond.simplify();
 }
 
-Expr getFpAssociativePrecondition() {
+vector<Expr> getFpAssociativeConstraints() {
   // Calling this function doesn't make sense if add is not associative
   assert(isFpAddAssociative);
 
-  Expr cond = Expr::mkBool(true);
+  vector<Expr> constraints;
   if (floatEnc)
-    cond &= floatEnc->getFpAssociativePrecondition();
+    constraints = floatEnc->getFpAssociativeConstraints();
 
-  if (doubleEnc)
-    cond &= doubleEnc->getFpAssociativePrecondition();
+  if (doubleEnc) {
+    auto doubleConstraints = doubleEnc->getFpAssociativeConstraints();
+    constraints.insert(constraints.end(), doubleConstraints.begin(),
+        doubleConstraints.end());
+  }
+
+  return constraints;
+}
+
+Expr getFpAssociativePrecondition() {
+  Expr cond = Expr::mkBool(true);
+  for (auto &c: getFpAssociativeConstraints())
+    cond &= c;
 
   return cond;
 }
@@ -1553,6 +1810,25 @@ Expr intSum(const Expr &a, const Expr &n,
 
 Expr intDot(const Expr &a, const Expr &b,
     const Expr &n, std::optional<smt::Expr> &&initValue) {
+  if (encodeLazily) {
+    bool constLen = n.isNumeral(), hasInit = initValue.has_value();
+
+    vector<Expr> args = {a, b};
+    if (!constLen)
+      args.push_back(n);
+    if (initValue)
+      args.push_back(*initValue);
+
+    return mkLazyOp("int_dot", a.select(Index::zero()).sort(), args,
+        [n, constLen, hasInit](const vector<Expr> &params) {
+      Expr len = constLen ? n : params[2];
+      optional<Expr> initValue;
+      if (hasInit)
+        initValue = params.back();
+      return intDot(params[0], params[1], len, std::move(initValue));
+    });
+  }
+
   if (abstraction.intDot == AbsLevelIntDot::FULLY_ABS) {
     usedOps.intDot = true;
 
@@ -79,11 +79,44 @@ void setEncodingOptions(bool useMultiset);
 // Release globally allocated objects for abstraction.
 void clearAbstractions();
 
+// Encode the ops whose encoding depends on the abstraction (fp sum, fp dot and
+// int dot) as applications of placeholder functions until the next
+// setAbstraction, so that the encoding can be reused under another
+// abstraction (see reabstract).
+// This is ignored if fp addition is associative, because the associativity
+// precondition relates the encoded sums.
+void setLazyEncoding(bool lazy);
+// Returns true if the placeholders of the current encoding can be instantiated
+// under abs. Changing fpCast changes the fp encodings, so it cannot.
+bool canReabstract(const Abstraction &abs);
+// Switch to abs, keeping the fp encodings and the placeholders.
+void reabstract(const Abstraction &abs);
+// Define the placeholders as the encodings of their ops under the current
+// abstraction (see smt::setFnDefinitions). The used abstract ops are updated
+// as if the ops were encoded.
+void instantiateLazyOps();
+// Returns the lazily encoded ops whose values in model change if they are
+// encoded under abs, which is more concrete than the abstraction they are
+// encoded under. These are the ops that the counterexample relies on. An op
+// whose value cannot be evaluated (e.g., it is applied to bound variables) is
+// included.
+std::vector<unsigned> findSpuriousLazyOps(const smt::Model &model,
+                                          const Abstraction &abs);
+// The number of lazily encoded ops that are not encoded under abs yet
+unsigned getNumLazyOpsToRefine(const Abstraction &abs);
+// Encode the ops (see findSpuriousLazyOps) under abs from the next
+// instantiateLazyOps, regardless of the current abstraction.
+// reabstract to another abstraction resets this.
+void refineLazyOps(const std::vector<unsigned> &ops, const Abstraction &abs);
+
 bool getFpAddAssociativity();
 bool getFpCastIsPrecise();
 
 smt::Expr getFpTruncatePrecondition();
 smt::Expr getFpAssociativePrecondition();
+// The conjuncts of getFpAssociativePrecondition(), so that they can be added
+// to a query one by one
+std::vector<smt::Expr> getFpAssociativeConstraints();
 smt::Expr getFpConstantPrecondition();
 
 void evalConsts(smt::Model model);
@@ -249,7 +282,7 @@ public:
   smt::Expr castFromSignedInt(const smt::Expr &integer);
   smt::Expr cmp(mlir::arith::CmpFPredicate pred, const smt::Expr &f1,
       const smt::Expr &f2);
-  smt::Expr getFpAssociativePrecondition();
+  std::vector<smt::Expr> getFpAssociativeConstraints();
   smt::Expr getFpTruncatePrecondition(aop::AbsFpEncoding &tgt);
   smt::Expr getFpConstantPrecondition();
 
@@ -2,8 +2,10 @@
 using namespace std;
 
 static bool is_verbose = false;
-static string dummy_str;
-static llvm::raw_string_ostream dummy_ss(dummy_str);
+static thread_local string dummy_str;
+static thread_local llvm::raw_string_ostream dummy_ss(dummy_str);
+static thread_local llvm::raw_ostream *out_stream = nullptr;
+static thread_local llvm::raw_ostream *err_stream = nullptr;
 
 void setVerbose(bool vb) {
   is_verbose = vb;
@@ -16,7 +18,20 @@ llvm::raw_ostream &verbose(const string &prefix) {
   if (!is_verbose)
     os = &dummy_ss;
   else
-    os = &llvm::outs();
+    os = &tvOuts();
   *os << "[" << prefix << "]: ";
   return *os;
-}
\ No newline at end of file
+}
+
+llvm::raw_ostream &tvOuts() {
+  return out_stream ? *out_stream : llvm::outs();
+}
+
+llvm::raw_ostream &tvErrs() {
+  return err_stream ? *err_stream : llvm::errs();
+}
+
+void redirectOutputs(llvm::raw_ostream *out, llvm::raw_ostream *err) {
+  out_stream = out;
+  err_stream = err;
+}
@@ -5,4 +5,13 @@
 
 void setVerbose(bool vb);
 
-llvm::raw_ostream &verbose(const std::string &prefix);
\ No newline at end of file
+llvm::raw_ostream &verbose(const std::string &prefix);
+
+// Streams that validation results and diagnostics are printed to.
+// They are llvm::outs() and llvm::errs() unless the calling thread redirected
+// them; worker threads do so to keep the output of each function together.
+llvm::raw_ostream &tvOuts();
+llvm::raw_ostream &tvErrs();
+// Redirect tvOuts() and tvErrs() of the calling thread. Passing nullptr
+// restores the default stream.
+void redirectOutputs(llvm::raw_ostream *out, llvm::raw_ostream *err);
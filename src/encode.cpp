@@ -2396,7 +2396,7 @@ void encodeOp(State &st, mlir::tensor::EmptyOp op, bool)
   }
 
   // FIXME: can we use res's name?
-  static int new_var_idx = 0;
+  static thread_local int new_var_idx = 0;
   st.regs.add(res, Tensor::var(ty.getElementType(),
                                ("init_tensor#") + to_string(new_var_idx++),
                                sizes, false));
@@ -3955,7 +3955,7 @@ static void assignRandomValue(State &st, mlir::Operation *op, bool printOp)
 {
   if (printOp)
   {
-    llvm::outs() << "    Assigning any value to this op ("
+    tvOuts() << "    Assigning any value to this op ("
                  << op->getName() << ")..\n";
   }
 
@@ -3998,7 +3998,7 @@ static void encodeBlock(
   {
     index++;
     if (printOps)
-      llvm::outs() << "  " << op << "\n";
+      tvOuts() << "  " << op << "\n";
 
     if (checkBeforeEnc && checkBeforeEnc(&op, index))
       continue;
@@ -4121,7 +4121,7 @@ static void encodeBlock(
     }
   }
   if (printOps)
-    llvm::outs() << "\n";
+    tvOuts() << "\n";
 }
 
 void encode(State &st, mlir::func::FuncOp &fn, bool printOps)
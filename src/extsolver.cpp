@@ -0,0 +1,173 @@
+#include "extsolver.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+vector<string> command;
+
+// Write script to an unlinked temporary file, so that the solver can read
+// it at its own pace and nothing is left behind. The file is opened
+// close-on-exec.
+int makeInputFile(const string &script) {
+  int fd;
+  llvm::SmallString<128> path;
+  if (llvm::sys::fs::createTemporaryFile("mlir-tv-query", "smt2", fd, path))
+    return -1;
+  llvm::sys::fs::remove(path);
+
+  size_t written = 0;
+  while (written < script.size()) {
+    ssize_t n = ::write(fd, script.data() + written, script.size() - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      ::close(fd);
+      return -1;
+    }
+    written += n;
+  }
+  ::lseek(fd, 0, SEEK_SET);
+  return fd;
+}
+
+extsolver::Result parseOutput(llvm::StringRef out) {
+  while (!out.empty()) {
+    auto [line, rest] = out.split('\n');
+    line = line.trim();
+    out = rest;
+    if (line == "sat")
+      return {extsolver::Answer::SAT, rest.str()};
+    else if (line == "unsat")
+      return {extsolver::Answer::UNSAT, ""};
+    else if (!line.empty())
+      // unknown, or an error message
+      break;
+  }
+  return {extsolver::Answer::UNKNOWN, ""};
+}
+}
+
+namespace extsolver {
+
+void setCommand(vector<string> &&cmd) {
+  command = std::move(cmd);
+}
+
+bool isEnabled() {
+  return !command.empty();
+}
+
+string getName() {
+  return isEnabled() ? llvm::sys::path::filename(command[0]).str() : "";
+}
+
+unique_ptr<Process> Process::start(const string &script) {
+  int inFd = makeInputFile(script);
+  if (inFd < 0)
+    return nullptr;
+
+  // Close-on-exec, so that the solvers that other threads start do not keep
+  // the pipe open
+  int fds[2];
+  if (::pipe2(fds, O_CLOEXEC)) {
+    ::close(inFd);
+    return nullptr;
+  }
+
+  vector<char *> argv;
+  for (auto &arg: command)
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  argv.push_back(nullptr);
+
+  pid_t pid = ::fork();
+  if (pid == 0) {
+    // Only async-signal-safe calls are allowed here because other threads
+    // may hold locks.
+    ::dup2(inFd, STDIN_FILENO);
+    ::dup2(fds[1], STDOUT_FILENO);
+    int devNull = ::open("/dev/null", O_WRONLY);
+    if (devNull >= 0)
+      ::dup2(devNull, STDERR_FILENO);
+    ::execvp(argv[0], argv.data());
+    ::_exit(127);
+  }
+
+  ::close(inFd);
+  ::close(fds[1]);
+  if (pid < 0) {
+    ::close(fds[0]);
+    return nullptr;
+  }
+  return unique_ptr<Process>(new Process(pid, fds[0]));
+}
+
+Process::~Process() {
+  // Reap the process if wait() was not called
+  if (pid > 0) {
+    ::kill(pid, SIGKILL);
+    ::waitpid(pid, nullptr, 0);
+  }
+  ::close(outFd);
+}
+
+Result Process::wait(uint64_t timeout_ms) {
+  auto deadline = chrono::steady_clock::now() +
+      chrono::milliseconds(timeout_ms);
+  string out;
+  bool timedOut = false;
+
+  while (true) {
+    auto remaining = chrono::duration_cast<chrono::milliseconds>(
+        deadline - chrono::steady_clock::now()).count();
+    if (remaining <= 0) {
+      timedOut = true;
+      break;
+    }
+
+    pollfd pfd = {outFd, POLLIN, 0};
+    int ready = ::poll(&pfd, 1, (int)min<int64_t>(remaining, 100));
+    if (ready < 0 && errno != EINTR)
+      break;
+    if (ready <= 0)
+      continue;
+
+    char buf[4096];
+    ssize_t n = ::read(outFd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    out.append(buf, n);
+  }
+
+  lock_guard<mutex> lock(mtx);
+  if (timedOut)
+    ::kill(pid, SIGKILL);
+  int status;
+  ::waitpid(pid, &status, 0);
+  pid = -1;
+
+  // A killed solver may have printed a partial answer
+  if (timedOut || !WIFEXITED(status))
+    return {Answer::UNKNOWN, ""};
+  return parseOutput(out);
+}
+
+void Process::kill() {
+  lock_guard<mutex> lock(mtx);
+  if (pid > 0)
+    ::kill(pid, SIGKILL);
+}
+
+} // namespace extsolver
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A solver that runs as a separate process, e.g., bitwuzla or yices-smt2.
+// It reads an SMT-LIB2 script from its standard input and prints the answer
+// of (check-sat) followed by the output of (get-model). The process is killed
+// when it exceeds the time limit.
+namespace extsolver {
+
+enum class Answer { SAT, UNSAT, UNKNOWN };
+
+struct Result {
+  Answer answer;
+  // The output that follows the answer; the model if the answer is sat
+  std::string model;
+};
+
+// The command line of the solver. This is set before validation starts and
+// shared by every thread.
+void setCommand(std::vector<std::string> &&cmd);
+bool isEnabled();
+// The name of the solver binary
+std::string getName();
+
+class Process {
+  std::mutex mtx;
+  // -1 once the process has been waited for
+  int pid;
+  int outFd;
+
+  Process(int pid, int outFd): pid(pid), outFd(outFd) {}
+
+public:
+  Process(const Process &) = delete;
+  ~Process();
+
+  // Start the solver on script. Returns nullptr if the solver cannot be
+  // started.
+  static std::unique_ptr<Process> start(const std::string &script);
+
+  // Wait until the solver answers or timeout_ms has passed.
+  // Must be called only once.
+  Result wait(uint64_t timeout_ms);
+  // Kill the solver. This can be called from another thread while wait()
+  // is running, which then returns UNKNOWN.
+  void kill();
+};
+
+} // namespace extsolver
@@ -1,4 +1,5 @@
 #include "function.h"
+#include "debug.h"
 #include "utils.h"
 
 #include <algorithm>
@@ -12,7 +13,7 @@ using namespace std;
 using namespace smt;
 
 namespace {
-map<string, DeclaredFunction, std::less<>> calleeMap;
+thread_local map<string, DeclaredFunction, std::less<>> calleeMap;
 } // namespace
 
 DeclaredFunction::DeclaredFunction(vector<mlir::Type> &&domain,
@@ -184,6 +185,10 @@ optional<DeclaredFunction> getDeclaredFunction(const std::string_view name) {
   }
 }
 
+void resetDeclaredFunctions() {
+  calleeMap.clear();
+}
+
 bool declareFunction(vector<mlir::Type> &&domain, mlir::Type &&range,
                      const string_view name,
                      optional<int64_t> &&dimsReferenceIdx) {
@@ -191,7 +196,7 @@ bool declareFunction(vector<mlir::Type> &&domain, mlir::Type &&range,
     // no-op if there already exists a function of the same name
     return false;
   } else {
-    llvm::outs() << "WARNING: Function \"" << name << "\" is assumed to be "
+    tvOuts() << "WARNING: Function \"" << name << "\" is assumed to be "
                  << "stateless and does not read or write global memory\n";
 
     calleeMap.insert({string(name),
@@ -36,3 +36,4 @@ getDeclaredFunction(const std::string_view name);
 bool declareFunction(std::vector<mlir::Type> &&domain, mlir::Type &&range,
                      const std::string_view name,
                      std::optional<int64_t> &&dimsReferenceIdx);
+void resetDeclaredFunctions();
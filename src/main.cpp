@@ -1,13 +1,19 @@
 #include "abstractops.h"
 #include "debug.h"
+#include "extsolver.h"
 #include "memory.h"
 #include "opts.h"
+#include "server.h"
 #include "smt.h"
+#include "stats.h"
 #include "vcgen.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/StringSaver.h"
 #include "mlir/Dialect/Affine/IR/AffineOps.h"
 #include "mlir/Dialect/Arith/IR/Arith.h"
 #include "mlir/Dialect/Bufferization/IR/Bufferization.h"
@@ -19,24 +25,35 @@
 #include "mlir/Dialect/SparseTensor/IR/SparseTensor.h"
 #include "mlir/Dialect/Tensor/IR/Tensor.h"
 #include "mlir/Dialect/Tosa/IR/TosaOps.h"
+#include "mlir/IR/Diagnostics.h"
 #include "mlir/IR/Dialect.h"
 #include "mlir/Parser/Parser.h"
 #include "mlir/Support/FileUtilities.h"
+#include <mutex>
+#include <optional>
 #include <string>
+#include <vector>
 
 using namespace std;
 using namespace mlir;
 
 llvm::cl::OptionCategory MlirTvCategory("mlir-tv options", "");
 
+// Not Required because they are not given in batch mode
 llvm::cl::opt<string> filename_src(llvm::cl::Positional,
   llvm::cl::desc("first-mlir-file"),
-  llvm::cl::Required, llvm::cl::value_desc("filename"),
+  llvm::cl::Optional, llvm::cl::value_desc("filename"),
   llvm::cl::cat(MlirTvCategory));
 
 llvm::cl::opt<string> filename_tgt(llvm::cl::Positional,
   llvm::cl::desc("second-mlir-file"),
-  llvm::cl::Required, llvm::cl::value_desc("filename"),
+  llvm::cl::Optional, llvm::cl::value_desc("filename"),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<string> arg_batch("batch",
+  llvm::cl::desc("Validate the pairs listed in a manifest. Each line has a "
+                 "source file, a target file and options for the pair"),
+  llvm::cl::value_desc("manifest"),
   llvm::cl::cat(MlirTvCategory));
 
 llvm::cl::opt<unsigned> arg_smt_to("smt-to",
@@ -44,13 +61,77 @@ llvm::cl::opt<unsigned> arg_smt_to("smt-to",
   llvm::cl::init(30000), llvm::cl::value_desc("ms"),
   llvm::cl::cat(MlirTvCategory));
 
+llvm::cl::opt<bool> arg_smt_rlimit("smt-rlimit",
+  llvm::cl::desc("Limit SMT queries by the solvers' resource units that"
+                 " correspond to --smt-to instead of by time, so that the"
+                 " results are the same on every host"),
+  llvm::cl::init(false),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<unsigned> arg_z3_rlimit_per_ms("z3-rlimit-per-ms",
+  llvm::cl::desc("The resource units that Z3 spends per millisecond, for"
+                 " --smt-rlimit (default=2000)"),
+  llvm::cl::init(2000), llvm::cl::value_desc("units"),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<unsigned> arg_cvc5_rlimit_per_ms("cvc5-rlimit-per-ms",
+  llvm::cl::desc("The resource units that cvc5 spends per millisecond, for"
+                 " --smt-rlimit. It has no default and must be measured"
+                 " (see mlir-tv-replay)"),
+  llvm::cl::init(0), llvm::cl::value_desc("units"),
+  llvm::cl::cat(MlirTvCategory));
+
 llvm::cl::opt<smt::SolverType> arg_solver(
     "solver",
     llvm::cl::desc("The SMT solver to use (default=Any)"),
     llvm::cl::values(clEnumValN(smt::SolverType::Z3, "Z3", "Z3"),
-                     clEnumValN(smt::SolverType::CVC5, "cvc5", "cvc5")),
+                     clEnumValN(smt::SolverType::CVC5, "cvc5", "cvc5"),
+                     clEnumValN(smt::SolverType::PORTFOLIO, "portfolio",
+                                "Run Z3 and cvc5 concurrently and use the"
+                                " first answer. cvc5 runs in time slices, so"
+                                " a query that only cvc5 answers takes up to"
+                                " about 3x as long as with --solver=cvc5")),
     llvm::cl::cat(MlirTvCategory));
 
+llvm::cl::list<string> arg_z3_tactic("z3-tactic",
+  llvm::cl::desc("Let Z3 solve the queries of a logic (e.g., QF_AUFBV) and a"
+                 " step (ub, retval, memory or notub) with a tactic pipeline,"
+                 " e.g., 'QF_AUFBV:*=simplify+bvarray2uf+ackermannize_bv"
+                 "+bit-blast+sat'. '*' matches any logic or step"),
+  llvm::cl::value_desc("logic:step=tactic+..."),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<string> arg_ext_solver("ext-solver",
+  llvm::cl::desc("Also run this SMT-LIB2 solver command on every query, e.g."
+                 " 'bitwuzla --produce-models'. It reads the query from its"
+                 " standard input"),
+  llvm::cl::value_desc("command"),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<string> arg_serve("serve",
+  llvm::cl::desc("Serve validation requests on a Unix domain socket"),
+  llvm::cl::value_desc("socket path"),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<unsigned> arg_serve_workers("serve-workers",
+  llvm::cl::desc("Number of --serve connections that are read and answered"
+                 " at once (default=4). The requests are still validated one"
+                 " at a time"),
+  llvm::cl::init(4), llvm::cl::value_desc("N"),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<unsigned> arg_serve_timeout("serve-timeout",
+  llvm::cl::desc("Time for a --serve client to send its request, 0 for no"
+                 " limit (default=10000)"),
+  llvm::cl::init(10000), llvm::cl::value_desc("ms"),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<string> arg_stats_json("stats-json",
+  llvm::cl::desc("Write per-function, per-iteration and per-query timings,"
+                 " term sizes and the peak memory usage as JSON"),
+  llvm::cl::value_desc("path"),
+  llvm::cl::cat(MlirTvCategory));
+
 llvm::cl::opt<bool> arg_verbose("verbose",
   llvm::cl::desc("Be verbose about what's going on"), llvm::cl::Hidden,
   llvm::cl::init(false),
@@ -60,35 +141,57 @@ llvm::cl::opt<bool> arg_verbose("verbose",
 // These functions are excerpted from ToolUtilities.cpp in mlir
 static unsigned validateBuffer(unique_ptr<llvm::MemoryBuffer> srcBuffer,
     unique_ptr<llvm::MemoryBuffer> tgtBuffer,
-    MLIRContext *context) {
+    MLIRContext *context, bool &hasUnsupported) {
   llvm::SourceMgr src_sourceMgr,  tgt_sourceMgr;
   src_sourceMgr.AddNewSourceBuffer(std::move(srcBuffer), llvm::SMLoc());
   tgt_sourceMgr.AddNewSourceBuffer(std::move(tgtBuffer), llvm::SMLoc());
 
-  auto ir_before = parseSourceFile<ModuleOp>(src_sourceMgr, context);
+  OwningOpRef<ModuleOp> ir_before, ir_after;
+  stats::Timer parseTimer;
+  {
+    SourceMgrDiagnosticHandler diagHandler(src_sourceMgr, context, tvErrs());
+    ir_before = parseSourceFile<ModuleOp>(src_sourceMgr, context);
+  }
   if (!ir_before) {
-    llvm::errs() << "Cannot parse source file\n";
+    tvErrs() << "Cannot parse source file\n";
     return 81;
   }
 
-  auto ir_after = parseSourceFile<ModuleOp>(tgt_sourceMgr, context);
+  {
+    SourceMgrDiagnosticHandler diagHandler(tgt_sourceMgr, context, tvErrs());
+    ir_after = parseSourceFile<ModuleOp>(tgt_sourceMgr, context);
+  }
   if (!ir_after) {
-    llvm::errs() << "Cannot parse target file\n";
+    tvErrs() << "Cannot parse target file\n";
     return 82;
   }
+  stats::addTime("parse", parseTimer.getMs());
 
-  return validate(ir_before, ir_after).code;
+  return validate(ir_before, ir_after, hasUnsupported).code;
 }
 
-int main(int argc, char* argv[]) {
-  llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
-  llvm::PrettyStackTraceProgram X(argc, argv);
-  llvm::EnableDebugBuffering = true;
+static unsigned validateFiles(const string &src, const string &tgt,
+    MLIRContext *context) {
+  string errorMessage;
+  auto src_file = openInputFile(src, &errorMessage);
+  if (!src_file) {
+    tvErrs() << errorMessage << "\n";
+    return 66;
+  }
 
-  llvm::cl::ParseCommandLineOptions(argc, argv);
-  setVerbose(arg_verbose.getValue());
+  auto tgt_file = openInputFile(tgt, &errorMessage);
+  if (!tgt_file) {
+    tvErrs() << errorMessage << "\n";
+    return 66;
+  }
 
-  smt::setTimeout(arg_smt_to.getValue());
+  bool hasUnsupported = false;
+  unsigned verificationResult = validateBuffer(
+      std::move(src_file), std::move(tgt_file), context, hasUnsupported);
+  return hasUnsupported ? UNSUPPORTED_EXIT_CODE : verificationResult;
+}
+
+static int setUpSolvers() {
   if (arg_solver.getNumOccurrences() == 0) {
 #ifdef SOLVER_Z3
     smt::useZ3();
@@ -113,8 +216,217 @@ int main(int argc, char* argv[]) {
                     "Consider adding '--solver=Z3' to mlir-tv.\n";
     return 1;
 #endif
+  } else if (arg_solver.getValue() == smt::PORTFOLIO) {
+#if defined(SOLVER_Z3) && defined(SOLVER_CVC5)
+    smt::useZ3();
+    smt::useCVC5();
+#else
+    llvm::errs() << "Both USE_Z3 and USE_cvc5 must be set while configuring "
+                    "this project to use '--solver=portfolio'!\n";
+    return 1;
+#endif
+  }
+  return 0;
+}
+
+// Apply --smt-rlimit, --z3-tactic and --ext-solver, replacing what was applied
+// before.
+static bool applySolverOptions(llvm::raw_ostream &errs) {
+  if (arg_smt_rlimit.getValue() && smt::getContextConfig().useCVC5 &&
+      arg_cvc5_rlimit_per_ms.getValue() == 0) {
+    errs << "--smt-rlimit needs --cvc5-rlimit-per-ms when cvc5 is used\n";
+    return false;
+  }
+  smt::setResourceLimit(arg_smt_rlimit.getValue(),
+      arg_z3_rlimit_per_ms.getValue(), arg_cvc5_rlimit_per_ms.getValue());
+
+  smt::clearZ3Tactics();
+  for (auto &arg: arg_z3_tactic) {
+    auto [key, pipeline] = llvm::StringRef(arg).split('=');
+    auto [logic, step] = key.split(':');
+    string err;
+    if (logic.empty() || step.empty() || pipeline.empty()) {
+      errs << "Invalid --z3-tactic: " << arg << "\n";
+      return false;
+    } else if (!smt::addZ3Tactic(logic.str(), step.str(), pipeline.str(),
+                                 err)) {
+      errs << "Invalid --z3-tactic: " << arg << ": " << err << "\n";
+      return false;
+    }
+  }
+  if (!arg_z3_tactic.empty() && !smt::getContextConfig().useZ3)
+    errs << "--z3-tactic has no effect because Z3 is not used\n";
+
+  llvm::BumpPtrAllocator alloc;
+  llvm::StringSaver saver(alloc);
+  llvm::SmallVector<const char *, 8> tokens;
+  llvm::cl::TokenizeGNUCommandLine(arg_ext_solver.getValue(), saver, tokens);
+  extsolver::setCommand(vector<string>(tokens.begin(), tokens.end()));
+  return true;
+}
+
+static optional<smt::SolverType> getSolverArg() {
+  if (arg_solver.getNumOccurrences() == 0)
+    return nullopt;
+  return arg_solver.getValue();
+}
+
+// Reset the options and parse the command line followed by extraArgs, so that
+// extraArgs override the command line. The solvers are not chosen again, but
+// their options are applied again. The stats are written once per process,
+// so --stats-json cannot be changed.
+static bool reparseOptions(int argc, char* argv[],
+    llvm::ArrayRef<const char *> extraArgs, llvm::raw_ostream &errs) {
+  string statsPath = arg_stats_json.getValue();
+  vector<const char *> args(argv, argv + argc);
+  args.insert(args.end(), extraArgs.begin(), extraArgs.end());
+  llvm::cl::ResetAllOptionOccurrences();
+  if (!llvm::cl::ParseCommandLineOptions(
+        args.size(), args.data(), "", &errs))
+    return false;
+
+  if (arg_stats_json.getValue() != statsPath) {
+    errs << "--stats-json cannot be changed per pair or request\n";
+    arg_stats_json.setValue(statsPath);
+    return false;
+  }
+
+  setVerbose(arg_verbose.getValue());
+  smt::setTimeout(arg_smt_to.getValue());
+  return applySolverOptions(errs);
+}
+
+// Validate the pairs in the manifest with the MLIR context and solvers that
+// are already set up. Before each pair, the options are reset and parsed
+// again from the command line followed by the options of the pair.
+// Relative paths in the manifest are relative to the manifest's directory.
+// Returns the largest exit code of the pairs.
+static unsigned validateBatch(int argc, char* argv[], MLIRContext *context) {
+  string manifest = arg_batch.getValue();
+  auto buffer = llvm::MemoryBuffer::getFile(manifest);
+  if (!buffer) {
+    llvm::errs() << "Cannot open " << manifest << ": "
+                 << buffer.getError().message() << "\n";
+    return 66;
+  }
+  auto baseDir = llvm::sys::path::parent_path(manifest);
+  auto initialSolver = getSolverArg();
+
+  auto resolvePath = [&](llvm::StringRef path) {
+    llvm::SmallString<128> resolved(path);
+    if (llvm::sys::path::is_relative(resolved) && !baseDir.empty())
+      llvm::sys::path::make_absolute(baseDir, resolved);
+    return string(resolved.str());
+  };
+
+  llvm::SmallVector<llvm::StringRef> lines;
+  (*buffer)->getBuffer().split(lines, '\n');
+
+  unsigned worstResult = 0;
+  for (size_t lineNo = 0; lineNo < lines.size(); ++lineNo) {
+    auto line = lines[lineNo].trim();
+    if (line.empty() || line.front() == '#')
+      continue;
+
+    llvm::BumpPtrAllocator alloc;
+    llvm::StringSaver saver(alloc);
+    llvm::SmallVector<const char *> tokens;
+    llvm::cl::TokenizeGNUCommandLine(line, saver, tokens);
+    if (tokens.size() < 2) {
+      llvm::errs() << manifest << ":" << lineNo + 1
+                   << ": expected a source and a target file\n";
+      worstResult = max(worstResult, 1u);
+      continue;
+    }
+
+    if (!reparseOptions(argc, argv, llvm::ArrayRef(tokens).drop_front(2),
+                        llvm::errs())) {
+      worstResult = max(worstResult, 1u);
+      continue;
+    }
+    if (getSolverArg() != initialSolver) {
+      llvm::errs() << manifest << ":" << lineNo + 1
+                   << ": --solver cannot be changed per pair; ignored\n";
+    }
+
+    string src = resolvePath(tokens[0]), tgt = resolvePath(tokens[1]);
+    llvm::outs() << "### " << src << " " << tgt << "\n";
+    unsigned result = validateFiles(src, tgt, context);
+    llvm::outs() << "### exit code: " << result << "\n";
+    llvm::outs().flush();
+    llvm::errs().flush();
+    worstResult = max(worstResult, result);
+  }
+  return worstResult;
+}
+
+// Validate the request with the options of the command line followed by the
+// options of the request. The output of the validation is sent back.
+static server::Response handleRequest(int argc, char* argv[],
+    MLIRContext *context, optional<smt::SolverType> initialSolver,
+    const server::Request &req) {
+  server::Response res;
+  llvm::raw_string_ostream os(res.output), es(res.errors);
+  redirectOutputs(&os, &es);
+
+  vector<const char *> extraArgs;
+  for (auto &arg: req.args)
+    extraArgs.push_back(arg.c_str());
+
+  if (!reparseOptions(argc, argv, extraArgs, es)) {
+    res.exitCode = 1;
+  } else {
+    if (getSolverArg() != initialSolver)
+      es << "--solver cannot be changed per request; ignored\n";
+
+    bool hasUnsupported = false;
+    res.exitCode = validateBuffer(
+        llvm::MemoryBuffer::getMemBufferCopy(req.src, req.srcName),
+        llvm::MemoryBuffer::getMemBufferCopy(req.tgt, req.tgtName),
+        context, hasUnsupported);
+    if (hasUnsupported)
+      res.exitCode = UNSUPPORTED_EXIT_CODE;
+  }
+
+  redirectOutputs(nullptr, nullptr);
+  os.flush();
+  es.flush();
+  return res;
+}
+
+int main(int argc, char* argv[]) {
+  llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
+  llvm::PrettyStackTraceProgram X(argc, argv);
+  llvm::EnableDebugBuffering = true;
+
+  llvm::cl::ParseCommandLineOptions(argc, argv);
+  setVerbose(arg_verbose.getValue());
+
+  bool isBatch = !arg_batch.getValue().empty();
+  bool isServer = !arg_serve.getValue().empty();
+  if (isBatch && isServer) {
+    llvm::errs() << "--batch and --serve cannot be used together\n";
+    return 1;
+  } else if ((isBatch || isServer) && filename_src.getNumOccurrences() != 0) {
+    llvm::errs() << "Input files cannot be given with --batch or --serve\n";
+    return 1;
+  } else if (!isBatch && !isServer &&
+             filename_tgt.getNumOccurrences() == 0) {
+    llvm::errs() << "Two input files must be given\n";
+    return 1;
   }
 
+  smt::setTimeout(arg_smt_to.getValue());
+  if (int res = setUpSolvers())
+    return res;
+  if (!applySolverOptions(llvm::errs()))
+    return 1;
+
+  // Batch and server mode may parse the options again, so keep the path here
+  string statsPath = arg_stats_json.getValue();
+  if (!statsPath.empty())
+    stats::enable();
+
   MLIRContext context;
   DialectRegistry registry;
   // NOTE: we cannot use mlir::registerAllDialects because IREE does not have
@@ -133,22 +445,33 @@ int main(int argc, char* argv[]) {
   context.appendDialectRegistry(registry);
   context.allowUnregisteredDialects();
 
-  string errorMessage;
-  auto src_file = openInputFile(filename_src, &errorMessage);
-  if (!src_file) {
-    llvm::errs() << errorMessage << "\n";
-    return 66;
+  unsigned verificationResult;
+  if (isServer) {
+    // The workers read the requests concurrently, but validate them one at a
+    // time because the options are global. Use -j to validate the functions
+    // of a request in parallel.
+    // The validations share one SMT context, so that its solvers and caches
+    // stay warm.
+    auto initialSolver = getSolverArg();
+    auto smtCtx = smt::makeContext(smt::getContextConfig());
+    setReuseSMTContext(true);
+    mutex validateMutex;
+    verificationResult = server::serve(arg_serve.getValue(),
+        arg_serve_workers.getValue(), arg_serve_timeout.getValue(),
+        [&](const server::Request &req) {
+          lock_guard<mutex> lock(validateMutex);
+          smt::ContextScope scope(*smtCtx);
+          return handleRequest(argc, argv, &context, initialSolver, req);
+        });
+  } else if (isBatch) {
+    verificationResult = validateBatch(argc, argv, &context);
+  } else {
+    verificationResult = validateFiles(filename_src, filename_tgt, &context);
   }
-
-  auto tgt_file = openInputFile(filename_tgt, &errorMessage);
-  if (!tgt_file) {
-    llvm::errs() << errorMessage << "\n";
-    return 66;
-  }
-
-  unsigned verificationResult = validateBuffer(
-      std::move(src_file), std::move(tgt_file), &context);
   smt::releaseResources();
 
+  if (!statsPath.empty() && !stats::write(statsPath))
+    llvm::errs() << "Cannot write the stats to " << statsPath << "\n";
+
   return verificationResult;
 }
@@ -441,27 +441,27 @@ pair<Expr, AccessInfo> Memory::loadArray(
   });
 }
 
+Expr Memory::refinesBlock(const Memory &other, mlir::Type elemTy,
+    unsigned ubid, const Expr &offset) const {
+  auto [srcValue, srcInfo] = other.load(elemTy, mkBID(ubid), offset);
+  auto srcWritable = srcInfo.writable;
+  auto [tgtValue, tgtInfo] = load(elemTy, mkBID(ubid), offset);
+  auto tgtWritable = tgtInfo.writable;
+
+  auto wRefinement = srcWritable.implies(tgtWritable);
+  auto [vRefinement, vRefParam] = ::refines(
+      *fromExpr(std::move(tgtValue), elemTy), *fromExpr(std::move(srcValue), elemTy));
+  assert(vRefParam.empty() && "Values stored in memory must be simple");
+
+  return (srcInfo.inbounds & srcInfo.liveness).implies(
+      tgtInfo.inbounds & tgtInfo.liveness & wRefinement & vRefinement);
+}
+
 TypeMap<pair<Expr, vector<Expr>>>
 Memory::refines(const Memory &other) const {
   assert(globalBlocksCnt == other.globalBlocksCnt);
 
   // Create fresh, unbound variables
-  auto refinesBlk = [this, &other](
-      mlir::Type elemTy, unsigned ubid, Index offset) {
-    auto [srcValue, srcInfo] = other.load(elemTy, mkBID(ubid), offset);
-    auto srcWritable = srcInfo.writable;
-    auto [tgtValue, tgtInfo] = load(elemTy, mkBID(ubid), offset);
-    auto tgtWritable = tgtInfo.writable;
-
-    auto wRefinement = srcWritable.implies(tgtWritable);
-    auto [vRefinement, vRefParam] = ::refines(
-        *fromExpr(std::move(tgtValue), elemTy), *fromExpr(std::move(srcValue), elemTy));
-    assert(vRefParam.empty() && "Values stored in memory must be simple");
-
-    return (srcInfo.inbounds & srcInfo.liveness).implies(
-        tgtInfo.inbounds & tgtInfo.liveness & wRefinement & vRefinement);
-  };
-
   using ElemTy = pair<Expr, vector<Expr>>;
   TypeMap<ElemTy> tmap;
 
@@ -472,7 +472,8 @@ Memory::refines(const Memory &other) const {
 
     for (unsigned i = 0; i < numblks; i ++)
       refinement = Expr::mkIte(
-          bid == Expr::mkBV(i, bidBits), refinesBlk(ty, i, offset), refinement);
+          bid == Expr::mkBV(i, bidBits), refinesBlock(other, ty, i, offset),
+          refinement);
 
     vector<Expr> params{bid, offset};
     ElemTy elem = {std::move(refinement), std::move(params)};
@@ -481,3 +482,21 @@ Memory::refines(const Memory &other) const {
 
   return tmap;
 }
+
+TypeMap<vector<pair<Expr, vector<Expr>>>>
+Memory::refinesPerBlock(const Memory &other) const {
+  assert(globalBlocksCnt == other.globalBlocksCnt);
+
+  TypeMap<vector<pair<Expr, vector<Expr>>>> tmap;
+  for (auto &[ty, numblks]: globalBlocksCnt) {
+    // A fresh, unbound variable that the obligations of ty share
+    auto offset = Index::var("offset_" + to_string(ty), VarType::FRESH);
+    auto &obligations = tmap[ty];
+    for (unsigned i = 0; i < numblks; i ++) {
+      vector<Expr> params{mkBID(i), offset};
+      obligations.emplace_back(refinesBlock(other, ty, i, offset),
+                               std::move(params));
+    }
+  }
+  return tmap;
+}
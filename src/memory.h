@@ -127,6 +127,9 @@ public:
   // Memory refinement is defined using global memory blocks only.
   TypeMap<std::pair<smt::Expr, std::vector<smt::Expr>>>
       refines(const Memory &other) const;
+  // The same relation as a separate obligation for each global block id.
+  TypeMap<std::vector<std::pair<smt::Expr, std::vector<smt::Expr>>>>
+      refinesPerBlock(const Memory &other) const;
 
   Memory *clone() const { return new Memory(*this); }
 
@@ -140,6 +143,10 @@ private:
       std::function<smt::Expr*(unsigned)> exprToUpdate, // bid -> ptr to expr
       std::function<smt::Expr(unsigned)> updatedValue) const; // bid -> updated
 
+  // The refinement of block ubid of other (src) by this (tgt) at offset
+  smt::Expr refinesBlock(const Memory &other, mlir::Type elemTy,
+      unsigned ubid, const smt::Expr &offset) const;
+
   AccessInfo getInfo(mlir::Type elemTy, const smt::Expr &bid,
       const smt::Expr &ofs) const;
   AccessInfo getInfo(mlir::Type elemTy, const smt::Expr &bid,
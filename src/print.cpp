@@ -1,6 +1,7 @@
 #include "mlir/Dialect/Func/IR/FuncOps.h"
 
 #include "abstractops.h"
+#include "debug.h"
 #include "opts.h"
 #include "print.h"
 
@@ -22,22 +23,22 @@ static void printInputs(Model m, mlir::func::FuncOp src, const State &st_src) {
   unsigned n = src.getNumArguments();
   for (unsigned i = 0; i < n; ++i) {
     auto argsrc = src.getArgument(i);
-    llvm::outs() << "\targ" << argsrc.getArgNumber() << " ("
+    tvOuts() << "\targ" << argsrc.getArgNumber() << " ("
         << argsrc.getType () << "): "
         << eval(st_src.regs.findOrCrash(argsrc), m) << "\n";
   }
 
-  llvm::outs() << "  Input memory:\n";
+  tvOuts() << "  Input memory:\n";
   auto &mem = *st_src.m;
   auto btys = mem.getBlockTypes();
   for (auto &bty: btys) {
-    llvm::outs() << "\tType " << bty << ":\n";
+    tvOuts() << "\tType " << bty << ":\n";
     unsigned num = mem.getNumBlocks(bty);
 
     for (unsigned i = 0; i < num; ++i) {
       auto numelem = m.eval(mem.getNumElementsOfMemBlock(bty, mem.mkBID(i)));
       auto liveness = m.eval(mem.getLiveness(bty, mem.mkBID(i)));
-      llvm::outs() << "\t  Block " << i << ": # elems: "
+      tvOuts() << "\t  Block " << i << ": # elems: "
           << intToStr(m.eval(numelem))
           << "\n";
     }
@@ -58,9 +59,9 @@ static Expr evalFromModel(Model m, Expr e) {
     else if (res.hasUnsat())
       wb = Expr::mkBool(false);
     else {
-      llvm::outs() << "\t\t(This operation's UB condition could not be "
+      tvOuts() << "\t\t(This operation's UB condition could not be "
           "evaluated for printing.\n";
-      llvm::outs() << "\t\t It does not affect the validaton result "
+      tvOuts() << "\t\t It does not affect the validaton result "
           "however.)\n";
     }
     smt::setTimeout(oldto);
@@ -70,17 +71,17 @@ static Expr evalFromModel(Model m, Expr e) {
 
 void printOperations(Model m, mlir::func::FuncOp fn, const State &st) {
   for (auto &op: fn.getRegion().front()) {
-    llvm::outs() << "\t" << op << "\n";
+    tvOuts() << "\t" << op << "\n";
 
     auto wb = evalFromModel(m, st.isOpWellDefined(&op));
     if (wb.isFalse()) {
-      llvm::outs() << "\t\t[This operation has undefined behavior!]\n";
+      tvOuts() << "\t\t[This operation has undefined behavior!]\n";
       auto ubmap = st.getOpWellDefinedness(&op);
       if (ubmap.size() > 1) {
         for (auto &[desc, eachwb]: ubmap) {
           Expr eachwb2 = evalFromModel(m, eachwb);
           string res = eachwb2.isFalse() ? "UB" : "okay";
-          llvm::outs() << "\t\t- "
+          tvOuts() << "\t\t- "
               << (desc.empty() ? "all other reasons" : desc)
               << ": " << res << "\n";
         }
@@ -90,7 +91,7 @@ void printOperations(Model m, mlir::func::FuncOp fn, const State &st) {
 
     if (op.getNumResults() > 0 && st.regs.contains(op.getResult(0))) {
       auto value = st.regs.findOrCrash(op.getResult(0));
-      llvm::outs() << "\t\tValue: " << eval(std::move(value), m) << "\n";
+      tvOuts() << "\t\tValue: " << eval(std::move(value), m) << "\n";
     }
   }
 }
@@ -99,50 +100,50 @@ void printCounterEx(
     Model m, const vector<Expr> &params, mlir::func::FuncOp src,
     mlir::func::FuncOp tgt, const State &st_src, const State &st_tgt,
     VerificationStep step, unsigned retvalidx, optional<mlir::Type> memElemTy) {
-  llvm::outs() << "<Inputs>\n";
+  tvOuts() << "<Inputs>\n";
   printInputs(m, src, st_src);
 
-  llvm::outs() << "\n<Source's instructions>\n";
+  tvOuts() << "\n<Source's instructions>\n";
   printOperations(m, src, st_src);
 
-  llvm::outs() << "\n<Target's instructions>\n";
+  tvOuts() << "\n<Target's instructions>\n";
   printOperations(m, tgt, st_tgt);
 
 
   if (step == VerificationStep::RetValue) {
     if (mlir::isa<mlir::TensorType>(src.getResultTypes()[retvalidx])) {
-      llvm::outs() << "\n<Returned tensor>\n";
+      tvOuts() << "\n<Returned tensor>\n";
 
       auto t_src = get<Tensor>(st_src.retValues[retvalidx]).eval(m);
       auto t_tgt = get<Tensor>(st_tgt.retValues[retvalidx]).eval(m);
       auto elemTy = t_src.getElemType();
       assert(elemTy == t_tgt.getElemType());
 
-      llvm::outs() << "Dimensions (src): " << or_omit(t_src.getDims()) << '\n';
-      llvm::outs() << "Dimensions (tgt): " << or_omit(t_tgt.getDims()) << '\n';
+      tvOuts() << "Dimensions (src): " << or_omit(t_src.getDims()) << '\n';
+      tvOuts() << "Dimensions (tgt): " << or_omit(t_tgt.getDims()) << '\n';
 
       if (params.size() > 0) {
         // More than size mismatch
         assert(params.size() == 1);
         auto param = m.eval(params[0]);
         auto indices = simplifyList(from1DIdx(param, t_src.getDims()));
-        llvm::outs() << "Index: " << or_omit(indices) << '\n';
+        tvOuts() << "Index: " << or_omit(indices) << '\n';
 
         auto srcElem = fromExpr(t_src.get(indices).simplify(), elemTy);
         auto tgtElem = fromExpr(t_tgt.get(indices).simplify(), elemTy);
-        llvm::outs() << "Element (src): " << *srcElem << '\n';
-        llvm::outs() << "Element (tgt): " << *tgtElem << '\n';
+        tvOuts() << "Element (src): " << *srcElem << '\n';
+        tvOuts() << "Element (tgt): " << *tgtElem << '\n';
       }
 
     } else {
-      llvm::outs() << "\n<Returned value>\n";
+      tvOuts() << "\n<Returned value>\n";
 
       for (auto &param: params)
-        llvm::outs() << "\tIndex: " << m.eval(param) << "\n";
+        tvOuts() << "\tIndex: " << m.eval(param) << "\n";
 
-      llvm::outs() << "\tSrc: " << eval(st_src.retValues[retvalidx], m)
+      tvOuts() << "\tSrc: " << eval(st_src.retValues[retvalidx], m)
                    << "\n";
-      llvm::outs() << "\tTgt: " << eval(st_tgt.retValues[retvalidx], m)
+      tvOuts() << "\tTgt: " << eval(st_tgt.retValues[retvalidx], m)
                    << "\n";
     }
   } else if (step == VerificationStep::Memory) {
@@ -170,21 +171,21 @@ void printCounterEx(
     srcLiveness = m.eval(srcLiveness);
     tgtLiveness = m.eval(tgtLiveness);
 
-    llvm::outs() << "\n<Final state of the mismatched memory>\n";
-    llvm::outs() << "\tBlock id: " << intToStr(bid);
+    tvOuts() << "\n<Final state of the mismatched memory>\n";
+    tvOuts() << "\tBlock id: " << intToStr(bid);
     if (bid_int) {
       if (auto glbname = st_src.m->getGlobalVarName(elemTy, *bid_int))
-        llvm::outs() << " (\"" << *glbname << "\")";
+        tvOuts() << " (\"" << *glbname << "\")";
     }
-    llvm::outs() << "\n";
-    llvm::outs() << "\t\telement type: " << to_string(elemTy) << "\n";
-    llvm::outs() << "\t\t# elements: " << intToStr(srcNumElems) << "\n";
-    llvm::outs() << "\t\tis writable (src): " << srcWritable << "\n";
-    llvm::outs() << "\t\tis writable (tgt): " << tgtWritable << "\n";
-    llvm::outs() << "\t\tliveness (src): " << srcLiveness << "\n";
-    llvm::outs() << "\t\tliveness (tgt): " << tgtLiveness << "\n";
-    llvm::outs() << "\tMismatched element offset: " << intToStr(offset) << "\n";
-    llvm::outs() << "\tSource value: " << srcValue << "\n";
-    llvm::outs() << "\tTarget value: " << tgtValue << "\n\n";
+    tvOuts() << "\n";
+    tvOuts() << "\t\telement type: " << to_string(elemTy) << "\n";
+    tvOuts() << "\t\t# elements: " << intToStr(srcNumElems) << "\n";
+    tvOuts() << "\t\tis writable (src): " << srcWritable << "\n";
+    tvOuts() << "\t\tis writable (tgt): " << tgtWritable << "\n";
+    tvOuts() << "\t\tliveness (src): " << srcLiveness << "\n";
+    tvOuts() << "\t\tliveness (tgt): " << tgtLiveness << "\n";
+    tvOuts() << "\tMismatched element offset: " << intToStr(offset) << "\n";
+    tvOuts() << "\tSource value: " << srcValue << "\n";
+    tvOuts() << "\tTarget value: " << tgtValue << "\n\n";
   }
 }
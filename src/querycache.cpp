@@ -0,0 +1,208 @@
+#include "querycache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+namespace fs = llvm::sys::fs;
+
+namespace {
+// The directory is set once before validation starts, so reading it from
+// worker threads is safe.
+string cacheDir;
+uint64_t maxNumEntries;
+atomic<uint64_t> numHits(0), numMisses(0), numStores(0), numEvictions(0);
+// The number of entries when the directory was last scanned, plus the stores
+// since then. Other processes' stores are counted at the next scan.
+atomic<uint64_t> numEntries(0);
+mutex evictMutex;
+
+const char *ENTRY_EXT = ".smtres";
+
+string entryPath(const string &key) {
+  llvm::SmallString<128> path(cacheDir);
+  llvm::sys::path::append(path, key + ENTRY_EXT);
+  return string(path.str());
+}
+
+// Remove the least recently used entries until at most maxEntries remain.
+// Hits update the modification time of an entry.
+// Returns the number of entries that remain.
+uint64_t evict(uint64_t maxEntries) {
+  vector<pair<llvm::sys::TimePoint<>, string>> entries;
+  error_code ec;
+  for (fs::directory_iterator it(cacheDir, ec), end; it != end && !ec;
+       it.increment(ec)) {
+    if (llvm::sys::path::extension(it->path()) != ENTRY_EXT)
+      continue;
+    auto status = it->status();
+    if (!status)
+      continue;
+    entries.emplace_back(status->getLastModificationTime(), it->path());
+  }
+
+  if (entries.size() <= maxEntries)
+    return entries.size();
+
+  sort(entries.begin(), entries.end());
+  size_t numRemove = entries.size() - maxEntries;
+  for (size_t i = 0; i < numRemove; ++i) {
+    // Another process may have removed it already.
+    if (!fs::remove(entries[i].second))
+      numEvictions++;
+  }
+  return maxEntries;
+}
+
+// Called after a store. Scanning the directory is slow, so a tenth of the
+// entries is removed at once and the next scan happens after as many stores.
+void evictIfFull() {
+  if (numEntries <= maxNumEntries)
+    return;
+  lock_guard<mutex> lock(evictMutex);
+  if (numEntries > maxNumEntries)
+    numEntries = evict(maxNumEntries - maxNumEntries / 10);
+}
+
+bool isSymbolChar(char c) {
+  return isalnum(c) || c == '_' || c == '.' || c == '!';
+}
+
+// Fresh variables are named "<prefix>#<counter>", and the counters depend on
+// what the process has encoded before. Renumber them in the order in which
+// they appear so that the same formula always has the same key.
+string canonicalize(const string &query) {
+  string out;
+  out.reserve(query.size());
+  map<string, size_t> renamed;
+
+  size_t i = 0;
+  while (i < query.size()) {
+    size_t hash = query.find('#', i);
+    if (hash == string::npos) {
+      out.append(query, i, string::npos);
+      break;
+    }
+
+    size_t end = hash + 1;
+    while (end < query.size() && isdigit(query[end]))
+      ++end;
+    size_t begin = hash;
+    while (begin > i && isSymbolChar(query[begin - 1]))
+      --begin;
+
+    out.append(query, i, hash - i);
+    if (end == hash + 1) {
+      out += '#';
+    } else {
+      auto name = query.substr(begin, end - begin);
+      auto itr = renamed.try_emplace(name, renamed.size()).first;
+      out += '#' + to_string(itr->second);
+    }
+    i = end;
+  }
+  return out;
+}
+
+void touch(const string &path) {
+  int fd;
+  if (fs::openFileForReadWrite(path, fd, fs::CD_OpenExisting, fs::OF_None))
+    return;
+  fs::setLastAccessAndModificationTime(fd, chrono::system_clock::now());
+  fs::closeFile(fd);
+}
+}
+
+namespace querycache {
+
+bool open(const string &dir, uint64_t maxEntries) {
+  if (fs::create_directories(dir))
+    return false;
+  cacheDir = dir;
+  maxNumEntries = maxEntries;
+  numEntries = evict(maxEntries);
+  return true;
+}
+
+bool isOpen() {
+  return !cacheDir.empty();
+}
+
+string makeKey(const string &query, const string &solvers,
+               const string &logic) {
+  llvm::SHA256 hasher;
+  string header = solvers + '\0' + logic + '\0';
+  hasher.update(header);
+  hasher.update(canonicalize(query));
+  return llvm::toHex(hasher.final(), /*LowerCase=*/true);
+}
+
+optional<CachedResult> lookup(const string &key, bool acceptSat) {
+  string path = entryPath(key);
+  auto buf = llvm::MemoryBuffer::getFile(path);
+  if (!buf) {
+    numMisses++;
+    return nullopt;
+  }
+
+  // The first line is the result. Entries written by older versions may
+  // have a model after it.
+  auto result = (*buf)->getBuffer().split('\n').first;
+  if ((result != "sat" || !acceptSat) && result != "unsat") {
+    numMisses++;
+    return nullopt;
+  }
+
+  numHits++;
+  touch(path);
+  return CachedResult{result == "sat"};
+}
+
+void store(const string &key, const CachedResult &res) {
+  // Write to a unique temporary file and rename it to the entry, so that
+  // readers never see a partially written entry even if several processes
+  // store the same key at once.
+  llvm::SmallString<128> model(cacheDir);
+  llvm::sys::path::append(model, "%%%%%%%%%%%%.tmp");
+  llvm::SmallString<128> tmpPath;
+  int fd;
+  if (fs::createUniqueFile(model, fd, tmpPath))
+    return;
+
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    os << (res.isSat ? "sat" : "unsat") << "\n";
+    os.close();
+    if (os.has_error()) {
+      os.clear_error();
+      fs::remove(tmpPath);
+      return;
+    }
+  }
+
+  if (fs::rename(tmpPath, entryPath(key))) {
+    fs::remove(tmpPath);
+    return;
+  }
+  numStores++;
+  // Replacing an entry of the same key is counted as well; the next scan
+  // corrects the count.
+  numEntries++;
+  evictIfFull();
+}
+
+Stats getStats() {
+  return {numHits, numMisses, numStores, numEvictions};
+}
+
+} // namespace querycache
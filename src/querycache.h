@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// A persistent cache of SMT query results, shared by mlir-tv processes that
+// use the same cache directory. Only sat and unsat results are cached.
+namespace querycache {
+
+// A counterexample cannot be loaded back into a Model, so only the answer is
+// kept.
+struct CachedResult {
+  bool isSat;
+};
+
+struct Stats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t stores;
+  uint64_t evictions;
+};
+
+// Use dir as the cache directory. When the cache has more than maxEntries
+// entries, at open or after a store, the least recently used ones are removed.
+// Returns false if the directory cannot be created.
+bool open(const std::string &dir, uint64_t maxEntries);
+bool isOpen();
+
+// The key of a query. query must be a serialization of the formula that does
+// not depend on the process; the other parameters change the answer a
+// solver may give. The timeout is not a part of the key: a sat or unsat
+// answer holds under any timeout.
+std::string makeKey(const std::string &query, const std::string &solvers,
+                    const std::string &logic);
+
+// A sat answer is returned only if acceptSat; otherwise it is counted as a
+// miss, e.g., because the caller needs a counterexample.
+std::optional<CachedResult> lookup(const std::string &key, bool acceptSat);
+void store(const std::string &key, const CachedResult &res);
+
+Stats getStats();
+
+} // namespace querycache
@@ -0,0 +1,456 @@
+// mlir-tv-replay: run the SMT-LIB2 queries that mlir-tv --dump-smt-to wrote
+// against the solvers that this tool is built with, under several solver
+// configurations, and report the result, solve time, resource units and peak
+// memory of each run. Every run is done in a child process so that runs do
+// not share solver state and their memory usage can be measured separately.
+#include "resourceunits.h"
+#include "stats.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cerrno>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef SOLVER_Z3
+#include "z3++.h"
+#endif
+#ifdef SOLVER_CVC5
+#include "cvc5/cvc5.h"
+#include "cvc5/cvc5_parser.h"
+#endif
+
+using namespace std;
+
+llvm::cl::OptionCategory ReplayCategory("mlir-tv-replay options", "");
+
+llvm::cl::opt<string> arg_dir(llvm::cl::Positional,
+  llvm::cl::desc("<directory of .smt2 files>"),
+  llvm::cl::Required, llvm::cl::cat(ReplayCategory));
+
+llvm::cl::list<string> arg_configs("config",
+  llvm::cl::desc("A solver configuration: <z3|cvc5>[:<option>=<value>,...]. "
+                 "For Z3, tactic=<t1>+<t2>+... solves with the tactics "
+                 "applied in sequence. May be given several times; each "
+                 "solver that is built in is used with its default options "
+                 "if omitted"),
+  llvm::cl::value_desc("config"), llvm::cl::cat(ReplayCategory));
+
+llvm::cl::opt<unsigned> arg_jobs("j",
+  llvm::cl::desc("The number of queries that run at once (default=1)"),
+  llvm::cl::init(1), llvm::cl::value_desc("number"),
+  llvm::cl::cat(ReplayCategory));
+
+llvm::cl::opt<unsigned> arg_smt_to("smt-to",
+  llvm::cl::desc("Timeout for SMT queries (default=30000)"),
+  llvm::cl::init(30000), llvm::cl::value_desc("ms"),
+  llvm::cl::cat(ReplayCategory));
+
+enum class Format { CSV, JSON };
+llvm::cl::opt<Format> arg_format("format",
+  llvm::cl::desc("The output format (default=csv)"),
+  llvm::cl::init(Format::CSV),
+  llvm::cl::values(
+    clEnumValN(Format::CSV, "csv", "Comma-separated values"),
+    clEnumValN(Format::JSON, "json", "A JSON array")),
+  llvm::cl::cat(ReplayCategory));
+
+llvm::cl::opt<string> arg_output("o",
+  llvm::cl::desc("The output file (default=stdout)"),
+  llvm::cl::init("-"), llvm::cl::value_desc("path"),
+  llvm::cl::cat(ReplayCategory));
+
+namespace {
+struct Config {
+  // As given in the command line
+  string name;
+  string solver;
+  vector<pair<string, string>> options;
+};
+
+// A file and a config to run it with
+struct Run {
+  size_t file;
+  size_t config;
+};
+
+struct Outcome {
+  // sat, unsat, unknown or error
+  string result = "error";
+  double solveMs = 0;
+  // The solver's deterministic work counter (Z3's rlimit, cvc5's resource
+  // units); -1 if unknown
+  int64_t resourceUnits = -1;
+  // In kilobytes
+  int64_t maxRSS = -1;
+};
+
+optional<Config> parseConfig(llvm::StringRef text) {
+  Config cfg;
+  cfg.name = text.str();
+  auto [solver, options] = text.split(':');
+  cfg.solver = solver.str();
+
+  bool supported = false;
+#ifdef SOLVER_Z3
+  supported |= solver == "z3";
+#endif
+#ifdef SOLVER_CVC5
+  supported |= solver == "cvc5";
+#endif
+  if (!supported) {
+    llvm::errs() << "Unknown or unsupported solver: " << solver << "\n";
+    return nullopt;
+  }
+
+  llvm::SmallVector<llvm::StringRef> pairs;
+  options.split(pairs, ',', -1, /*KeepEmpty=*/false);
+  for (auto p: pairs) {
+    auto [key, value] = p.split('=');
+    if (key.empty() || value.empty()) {
+      llvm::errs() << "Invalid option in " << text << ": " << p << "\n";
+      return nullopt;
+    }
+    cfg.options.emplace_back(key.str(), value.str());
+  }
+  return cfg;
+}
+
+#ifdef SOLVER_Z3
+void setZ3Param(z3::context &ctx, z3::params &params, const string &key,
+                const string &value) {
+  unsigned n;
+  double d;
+  if (value == "true" || value == "false")
+    params.set(key.c_str(), value == "true");
+  else if (!llvm::StringRef(value).getAsInteger(10, n))
+    params.set(key.c_str(), n);
+  else if (!llvm::StringRef(value).getAsDouble(d))
+    params.set(key.c_str(), d);
+  else
+    params.set(key.c_str(), ctx.str_symbol(value.c_str()));
+}
+
+Outcome runZ3(const string &path, const Config &cfg) {
+  z3::context ctx;
+  z3::params params(ctx);
+  optional<z3::tactic> tactic;
+  for (auto &[key, value]: cfg.options) {
+    if (key != "tactic") {
+      setZ3Param(ctx, params, key, value);
+      continue;
+    }
+    llvm::SmallVector<llvm::StringRef> names;
+    llvm::StringRef(value).split(names, '+');
+    for (auto name: names) {
+      z3::tactic t(ctx, name.str().c_str());
+      tactic = tactic ? *tactic & t : t;
+    }
+  }
+  params.set("timeout", arg_smt_to.getValue());
+
+  // Fall back to the default tactic as mlir-tv --z3-tactic does
+  z3::solver s = tactic ? (*tactic | z3::tactic(ctx, "default")).mk_solver() :
+      z3::solver(ctx);
+  s.set(params);
+  s.from_file(path.c_str());
+
+  Outcome o;
+  auto units = resourceunits::getZ3Count(s);
+  stats::Timer timer;
+  auto res = s.check();
+  o.solveMs = timer.getMs();
+  o.resourceUnits = resourceunits::getZ3Count(s) - units;
+  o.result = res == z3::sat ? "sat" : (res == z3::unsat ? "unsat" : "unknown");
+  return o;
+}
+#endif // SOLVER_Z3
+
+#ifdef SOLVER_CVC5
+Outcome runCVC5(const string &path, const Config &cfg) {
+  cvc5::TermManager tm;
+  cvc5::Solver solver(tm);
+  solver.setOption("tlimit-per", to_string(arg_smt_to.getValue()));
+  for (auto &[key, value]: cfg.options)
+    solver.setOption(key, value);
+
+  cvc5::parser::SymbolManager sm(tm);
+  cvc5::parser::InputParser parser(&solver, &sm);
+  parser.setFileInput(cvc5::modes::InputLanguage::SMT_LIB_2_6, path);
+
+  Outcome o;
+  o.result = "unknown";
+  while (true) {
+    auto cmd = parser.nextCommand();
+    if (cmd.isNull())
+      break;
+
+    ostringstream out;
+    bool isCheck = cmd.getCommandName() == "check-sat";
+    auto units = isCheck ? resourceunits::getCVC5Count(solver) : nullopt;
+    stats::Timer timer;
+    cmd.invoke(&solver, &sm, out);
+    if (isCheck) {
+      o.solveMs += timer.getMs();
+      o.result = llvm::StringRef(out.str()).trim().str();
+      auto after = resourceunits::getCVC5Count(solver);
+      if (units && after)
+        o.resourceUnits = max<int64_t>(o.resourceUnits, 0) + *after - *units;
+    }
+  }
+  return o;
+}
+#endif // SOLVER_CVC5
+
+// Runs in the child process. Writes "<result> <solve ms> <resource units>" to
+// fd.
+void runQuery(const string &path, const Config &cfg, int fd) {
+  Outcome o;
+  try {
+#ifdef SOLVER_Z3
+    if (cfg.solver == "z3")
+      o = runZ3(path, cfg);
+#endif
+#ifdef SOLVER_CVC5
+    if (cfg.solver == "cvc5")
+      o = runCVC5(path, cfg);
+#endif
+  } catch (const exception &e) {
+    // Both solvers throw exceptions that derive from std::exception
+    llvm::errs() << path << " (" << cfg.name << "): "
+                 << llvm::StringRef(e.what()).rtrim() << "\n";
+  }
+
+  string msg = o.result + " " + to_string(o.solveMs) + " " +
+      to_string(o.resourceUnits) + "\n";
+  size_t written = 0;
+  while (written < msg.size()) {
+    ssize_t n = ::write(fd, msg.data() + written, msg.size() - written);
+    if (n <= 0)
+      break;
+    written += n;
+  }
+}
+
+Outcome readOutcome(int fd, int status, const rusage &usage) {
+  string msg;
+  char buf[256];
+  ssize_t n;
+  while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+    msg.append(buf, n);
+
+  Outcome o;
+  o.maxRSS = usage.ru_maxrss;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    return o;
+
+  llvm::SmallVector<llvm::StringRef, 3> fields;
+  llvm::StringRef(msg).trim().split(fields, ' ');
+  if (fields.size() != 3 || fields[1].getAsDouble(o.solveMs) ||
+      fields[2].getAsInteger(10, o.resourceUnits))
+    return o;
+  o.result = fields[0].str();
+  return o;
+}
+
+// The solver that mlir-tv wrote the file for. mlir-tv names the files
+// <prefix>.<z3|cvc5>.<query>.smt2 (see --dump-smt-to). Empty if the name has
+// no solver.
+string getSolverTag(const string &path) {
+  llvm::SmallVector<llvm::StringRef> parts;
+  llvm::sys::path::filename(path).split(parts, '.');
+  for (auto itr = parts.rbegin(); itr != parts.rend(); ++itr) {
+    if (*itr == "z3" || *itr == "cvc5")
+      return itr->str();
+  }
+  return "";
+}
+
+// The (file, config) pairs to run. The dumps of one solver may use syntax
+// that the other solver does not accept, so a file is run only with the
+// configs of the solver it was written for.
+vector<Run> planRuns(const vector<string> &files,
+                     const vector<Config> &configs) {
+  vector<Run> runs;
+  size_t numSkipped = 0;
+  for (size_t f = 0; f < files.size(); ++f) {
+    auto tag = getSolverTag(files[f]);
+    for (size_t c = 0; c < configs.size(); ++c) {
+      if (tag.empty() || tag == configs[c].solver)
+        runs.push_back({f, c});
+      else
+        ++numSkipped;
+    }
+  }
+  if (numSkipped)
+    llvm::errs() << "Skipped " << numSkipped << " runs of files that were "
+                    "written for another solver\n";
+  return runs;
+}
+
+// Run the pairs in child processes, at most numJobs at once.
+vector<Outcome> runAll(const vector<string> &files,
+                       const vector<Config> &configs, const vector<Run> &runs,
+                       unsigned numJobs) {
+  size_t numRuns = runs.size();
+  vector<Outcome> outcomes(numRuns);
+  // pid -> (run, read end of the pipe)
+  map<pid_t, pair<size_t, int>> running;
+  size_t next = 0;
+
+  while (next < numRuns || !running.empty()) {
+    if (next < numRuns && running.size() < numJobs) {
+      size_t run = next++;
+      auto &file = files[runs[run].file];
+      auto &cfg = configs[runs[run].config];
+
+      int fds[2];
+      if (::pipe(fds)) {
+        llvm::errs() << "Cannot create a pipe for " << file << "\n";
+        continue;
+      }
+      // Do not duplicate buffered output in the child
+      llvm::outs().flush();
+      llvm::errs().flush();
+      pid_t pid = ::fork();
+      if (pid == 0) {
+        ::close(fds[0]);
+        runQuery(file, cfg, fds[1]);
+        ::close(fds[1]);
+        llvm::errs().flush();
+        ::_exit(0);
+      }
+      ::close(fds[1]);
+      if (pid < 0) {
+        llvm::errs() << "Cannot start a process for " << file << "\n";
+        ::close(fds[0]);
+        continue;
+      }
+      running[pid] = {run, fds[0]};
+      continue;
+    }
+
+    int status;
+    rusage usage;
+    pid_t pid = ::wait4(-1, &status, 0, &usage);
+    if (pid < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    auto itr = running.find(pid);
+    if (itr == running.end())
+      continue;
+    auto [run, fd] = itr->second;
+    outcomes[run] = readOutcome(fd, status, usage);
+    ::close(fd);
+    running.erase(itr);
+  }
+  return outcomes;
+}
+
+string csvField(const string &s) {
+  if (s.find_first_of(",\"\n") == string::npos)
+    return s;
+  string quoted = "\"";
+  for (char c: s) {
+    if (c == '"')
+      quoted += '"';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+void writeCSV(llvm::raw_ostream &os, const vector<string> &files,
+              const vector<Config> &configs, const vector<Run> &runs,
+              const vector<Outcome> &outcomes) {
+  os << "file,config,result,solve_ms,resource_units,max_rss_kb\n";
+  for (size_t i = 0; i < outcomes.size(); ++i) {
+    auto &o = outcomes[i];
+    os << csvField(files[runs[i].file]) << ","
+       << csvField(configs[runs[i].config].name) << "," << o.result << ","
+       << llvm::format("%.3f", o.solveMs) << "," << o.resourceUnits << ","
+       << o.maxRSS << "\n";
+  }
+}
+
+void writeJSON(llvm::raw_ostream &os, const vector<string> &files,
+               const vector<Config> &configs, const vector<Run> &runs,
+               const vector<Outcome> &outcomes) {
+  llvm::json::OStream json(os, 2);
+  json.array([&]() {
+    for (size_t i = 0; i < outcomes.size(); ++i) {
+      auto &o = outcomes[i];
+      json.object([&]() {
+        json.attribute("file", files[runs[i].file]);
+        json.attribute("config", configs[runs[i].config].name);
+        json.attribute("result", o.result);
+        json.attribute("solve_ms", o.solveMs);
+        json.attribute("resource_units", o.resourceUnits);
+        json.attribute("max_rss_kb", o.maxRSS);
+      });
+    }
+  });
+  os << "\n";
+}
+}
+
+int main(int argc, char* argv[]) {
+  llvm::cl::HideUnrelatedOptions(ReplayCategory);
+  llvm::cl::ParseCommandLineOptions(argc, argv,
+      "Replays the queries written by mlir-tv --dump-smt-to\n");
+
+  vector<Config> configs;
+  for (auto &text: arg_configs) {
+    auto cfg = parseConfig(text);
+    if (!cfg)
+      return 1;
+    configs.push_back(std::move(*cfg));
+  }
+  if (configs.empty()) {
+#ifdef SOLVER_Z3
+    configs.push_back(*parseConfig("z3"));
+#endif
+#ifdef SOLVER_CVC5
+    configs.push_back(*parseConfig("cvc5"));
+#endif
+  }
+
+  vector<string> files;
+  error_code ec;
+  for (llvm::sys::fs::directory_iterator it(arg_dir, ec), end;
+       it != end && !ec; it.increment(ec)) {
+    if (llvm::sys::path::extension(it->path()) == ".smt2")
+      files.push_back(it->path());
+  }
+  if (ec) {
+    llvm::errs() << "Cannot read " << arg_dir << ": " << ec.message() << "\n";
+    return 1;
+  }
+  sort(files.begin(), files.end());
+
+  auto runs = planRuns(files, configs);
+  auto outcomes = runAll(files, configs, runs, max(1u, arg_jobs.getValue()));
+
+  llvm::raw_fd_ostream fout(arg_output, ec, llvm::sys::fs::OF_Text);
+  if (ec) {
+    llvm::errs() << "Cannot open " << arg_output << ": " << ec.message()
+                 << "\n";
+    return 1;
+  }
+  if (arg_format == Format::CSV)
+    writeCSV(fout, files, configs, runs, outcomes);
+  else
+    writeJSON(fout, files, configs, runs, outcomes);
+  return 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#ifdef SOLVER_Z3
+#include "z3++.h"
+#endif
+#ifdef SOLVER_CVC5
+#include "cvc5/cvc5.h"
+#endif
+
+// The deterministic work counters of the solvers (Z3's rlimit, cvc5's
+// resource units). Both only grow, so the units of a check are the difference
+// of the counts before and after it. Shared by mlir-tv and mlir-tv-replay,
+// which does not link the rest of mlir-tv.
+namespace resourceunits {
+
+#ifdef SOLVER_Z3
+// The resource units that the context of s has spent so far
+inline uint64_t getZ3Count(const z3::solver &s) {
+  // statistics() is not const; a copy shares the solver
+  auto st = z3::solver(s).statistics();
+  for (unsigned i = 0; i < st.size(); ++i) {
+    if (st.key(i) == "rlimit count")
+      return st.is_uint(i) ? st.uint_value(i) : (uint64_t)st.double_value(i);
+  }
+  // Z3 leaves out the statistics that are zero
+  return 0;
+}
+#endif // SOLVER_Z3
+
+#ifdef SOLVER_CVC5
+// nullopt if the solver does not report the statistic
+inline std::optional<uint64_t> getCVC5Count(cvc5::Solver &s) {
+  try {
+    return s.getStatistics().get("resource::resourceUnitsUsed").getInt();
+  } catch (const cvc5::CVC5ApiException &) {
+    return std::nullopt;
+  }
+}
+#endif // SOLVER_CVC5
+
+} // namespace resourceunits
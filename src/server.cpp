@@ -0,0 +1,306 @@
+#include "server.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+timeval toTimeval(chrono::milliseconds ms) {
+  timeval tv;
+  tv.tv_sec = ms.count() / 1000;
+  tv.tv_usec = (ms.count() % 1000) * 1000;
+  return tv;
+}
+
+class Connection {
+  int fd;
+  string buf;
+  size_t pos = 0;
+  // The request must arrive by the deadline, if any
+  optional<chrono::steady_clock::time_point> deadline;
+  bool timedOut = false;
+
+  bool fill() {
+    char tmp[4096];
+    while (true) {
+      if (deadline) {
+        auto left = chrono::duration_cast<chrono::milliseconds>(
+            *deadline - chrono::steady_clock::now());
+        if (left.count() <= 0) {
+          timedOut = true;
+          return false;
+        }
+        auto tv = toTimeval(left);
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      }
+
+      ssize_t n = ::read(fd, tmp, sizeof(tmp));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        timedOut = true;
+        return false;
+      }
+      if (n <= 0)
+        return false;
+      buf.append(tmp, n);
+      return true;
+    }
+  }
+
+public:
+  // A timeout of 0 means no timeout. Otherwise the whole request must be read
+  // within it, and each send of the response must make progress within it.
+  Connection(int fd, unsigned timeoutMs): fd(fd) {
+    if (timeoutMs == 0)
+      return;
+    deadline = chrono::steady_clock::now() +
+        chrono::milliseconds(timeoutMs);
+    auto tv = toTimeval(chrono::milliseconds(timeoutMs));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  }
+  Connection(const Connection &) = delete;
+  ~Connection() { ::close(fd); }
+
+  bool hasTimedOut() const { return timedOut; }
+
+  optional<string> readLine() {
+    size_t nl;
+    while ((nl = buf.find('\n', pos)) == string::npos) {
+      if (!fill())
+        return nullopt;
+    }
+    string line = buf.substr(pos, nl - pos);
+    pos = nl + 1;
+    return line;
+  }
+
+  optional<string> readBytes(size_t n) {
+    while (buf.size() - pos < n) {
+      if (!fill())
+        return nullopt;
+    }
+    string bytes = buf.substr(pos, n);
+    pos += n;
+    return bytes;
+  }
+
+  bool write(const string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+      // MSG_NOSIGNAL: a client that went away must not kill the server
+      ssize_t n = ::send(fd, data.data() + sent, data.size() - sent,
+                         MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      sent += n;
+    }
+    return true;
+  }
+};
+
+// Reads the module text of a src/src-path (or tgt/tgt-path) line.
+optional<string> readModule(Connection &conn, llvm::StringRef key,
+                            llvm::StringRef value, string &name,
+                            string &error) {
+  if (key == "src-path" || key == "tgt-path") {
+    auto buffer = llvm::MemoryBuffer::getFile(value);
+    if (!buffer) {
+      error = "Cannot open " + value.str() + ": " +
+          buffer.getError().message();
+      return nullopt;
+    }
+    name = value.str();
+    return (*buffer)->getBuffer().str();
+  }
+
+  size_t size;
+  if (value.getAsInteger(10, size)) {
+    error = "Invalid size: " + value.str();
+    return nullopt;
+  }
+  auto text = conn.readBytes(size);
+  if (!text)
+    error = conn.hasTimedOut() ? "Timed out while reading the request" :
+        "The connection was closed in the middle of the request";
+  name = key.str();
+  return text;
+}
+
+optional<server::Request> readRequest(
+    Connection &conn, bool &shutdown, string &error) {
+  server::Request req;
+  bool hasSrc = false, hasTgt = false;
+
+  while (auto line = conn.readLine()) {
+    auto [key, value] = llvm::StringRef(*line).split(' ');
+
+    if (key == "shutdown") {
+      shutdown = true;
+      return nullopt;
+    } else if (key == "arg") {
+      req.args.push_back(value.str());
+    } else if (key == "src" || key == "src-path") {
+      auto text = readModule(conn, key, value, req.srcName, error);
+      if (!text)
+        return nullopt;
+      req.src = std::move(*text);
+      hasSrc = true;
+    } else if (key == "tgt" || key == "tgt-path") {
+      auto text = readModule(conn, key, value, req.tgtName, error);
+      if (!text)
+        return nullopt;
+      req.tgt = std::move(*text);
+      hasTgt = true;
+    } else if (key == "end") {
+      if (!hasSrc || !hasTgt) {
+        error = "A request needs both src and tgt";
+        return nullopt;
+      }
+      return req;
+    } else {
+      error = "Unknown request line: " + *line;
+      return nullopt;
+    }
+  }
+
+  error = conn.hasTimedOut() ? "Timed out while reading the request" :
+      "The connection was closed in the middle of the request";
+  return nullopt;
+}
+
+string toString(const server::Response &res) {
+  return "exit-code " + to_string(res.exitCode) + "\n" +
+      "stdout " + to_string(res.output.size()) + "\n" + res.output +
+      "stderr " + to_string(res.errors.size()) + "\n" + res.errors;
+}
+}
+
+namespace server {
+
+int serve(const string &path, unsigned numWorkers, unsigned timeoutMs,
+          function<Response(const Request &)> handler) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    llvm::errs() << "The socket path is too long: " << path << "\n";
+    return 1;
+  }
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  // Remove the socket file that a previous server left, but never a file of
+  // another kind
+  struct stat st;
+  if (::lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      llvm::errs() << "Cannot listen on " << path
+                   << ": the file exists and is not a socket\n";
+      return 1;
+    }
+    ::unlink(path.c_str());
+  }
+
+  int sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0) {
+    llvm::errs() << "Cannot create a socket: " << strerror(errno) << "\n";
+    return 1;
+  }
+  if (::bind(sock, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      ::listen(sock, SOMAXCONN) < 0) {
+    llvm::errs() << "Cannot listen on " << path << ": " << strerror(errno)
+                 << "\n";
+    ::close(sock);
+    return 1;
+  }
+
+  // The accepted connections wait in a queue for a worker. A client that is
+  // slow to send its request holds up only its own worker.
+  mutex queueMutex;
+  condition_variable queueCond;
+  deque<int> pending;
+  bool stopping = false;
+  atomic<bool> shutdown(false);
+
+  auto worker = [&]() {
+    while (true) {
+      int fd;
+      {
+        unique_lock<mutex> lock(queueMutex);
+        queueCond.wait(lock, [&]() { return stopping || !pending.empty(); });
+        if (pending.empty())
+          return;
+        fd = pending.front();
+        pending.pop_front();
+      }
+
+      Connection conn(fd, timeoutMs);
+      bool isShutdown = false;
+      string error;
+      if (auto req = readRequest(conn, isShutdown, error)) {
+        conn.write(toString(handler(*req)));
+      } else if (isShutdown) {
+        shutdown = true;
+        // Wake up the accept() of the main thread
+        ::shutdown(sock, SHUT_RDWR);
+      } else {
+        conn.write(toString({1, "", error + "\n"}));
+      }
+    }
+  };
+
+  vector<thread> workers;
+  for (unsigned i = 0; i < max(numWorkers, 1u); ++i)
+    workers.emplace_back(worker);
+
+  while (!shutdown) {
+    int fd = ::accept(sock, nullptr, nullptr);
+    if (fd < 0) {
+      if (shutdown)
+        break;
+      if (errno == EINTR)
+        continue;
+      llvm::errs() << "Cannot accept a connection: " << strerror(errno)
+                   << "\n";
+      break;
+    }
+
+    {
+      lock_guard<mutex> lock(queueMutex);
+      pending.push_back(fd);
+    }
+    queueCond.notify_one();
+  }
+
+  // The connections in the queue are still answered
+  {
+    lock_guard<mutex> lock(queueMutex);
+    stopping = true;
+  }
+  queueCond.notify_all();
+  for (auto &t: workers)
+    t.join();
+
+  ::close(sock);
+  ::unlink(path.c_str());
+  return 0;
+}
+
+} // namespace server
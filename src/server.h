@@ -0,0 +1,46 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// The protocol of mlir-tv --serve. A client connects to the Unix domain
+// socket, sends one request and reads one response. Sizes are in bytes.
+//
+// Request:
+//   arg <option>                  (any number of times)
+//   src-path <path> | src <size>  (followed by <size> bytes of MLIR)
+//   tgt-path <path> | tgt <size>
+//   end
+// A request that consists of "shutdown" stops the server.
+//
+// Response:
+//   exit-code <code>
+//   stdout <size>                 (followed by <size> bytes)
+//   stderr <size>
+namespace server {
+
+struct Request {
+  std::vector<std::string> args;
+  std::string src, tgt;
+  // Used as the buffer names of src and tgt
+  std::string srcName, tgtName;
+};
+
+struct Response {
+  unsigned exitCode;
+  std::string output;
+  std::string errors;
+};
+
+// Listen on a Unix domain socket at path. numWorkers threads read the
+// requests and call handler, so handler must be thread-safe. A connection
+// that does not send its whole request within timeoutMs (0: no limit) is
+// answered with an error. An existing file at path is replaced only if it is
+// a socket.
+// Returns when a shutdown request arrives, or returns nonzero if the socket
+// cannot be set up.
+int serve(const std::string &path, unsigned numWorkers, unsigned timeoutMs,
+          std::function<Response(const Request &)> handler);
+
+} // namespace server
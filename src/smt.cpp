@@ -1,7 +1,18 @@
 #include "value.h"
 #include "smt.h"
+#include "debug.h"
 #include "smtmatchers.h"
+#include "extsolver.h"
+#include "resourceunits.h"
 #include "utils.h"
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #ifdef SOLVER_Z3
 #define SET_Z3(e, v) (e).setZ3(v)
@@ -69,24 +80,47 @@ private:
 
 public:
   uint64_t timeout_ms;
+  bool use_rlimit;
+  // See setFnDefinitions
+  vector<FnDefinition> fn_definitions;
+
+  // The resource units that the solvers spend per millisecond on the host
+  // (see setResourceLimit). They are process-wide.
+  static atomic<uint64_t> z3_units_per_ms, cvc5_units_per_ms;
 
   Context() {
     fresh_var_counter = 0;
     timeout_ms = 10000;
+    use_rlimit = false;
   }
 
 #ifdef SOLVER_Z3
+  // 0 means no limit for both parameters
+  void setZ3Limits(z3::context &ctx) const {
+    bool byUnits = use_rlimit && z3_units_per_ms > 0;
+    uint64_t rlimit = byUnits ? timeout_ms * z3_units_per_ms : 0;
+    ctx.set("timeout", to_string(byUnits ? UINT_MAX : timeout_ms).c_str());
+    ctx.set("rlimit", to_string(min<uint64_t>(rlimit, UINT_MAX)).c_str());
+  }
+
   void useZ3() {
     this->z3.emplace();
-    this->z3->set("timeout", (int)timeout_ms);
+    setZ3Limits(*this->z3);
   }
 #endif
 #ifdef SOLVER_CVC5
+  void setCVC5Limits() {
+    bool byUnits = use_rlimit && cvc5_units_per_ms > 0;
+    uint64_t rlimit = byUnits ? timeout_ms * cvc5_units_per_ms : 0;
+    this->cvc5->setOption("tlimit-per", to_string(byUnits ? 0 : timeout_ms));
+    this->cvc5->setOption("rlimit-per", to_string(rlimit));
+  }
+
   void useCVC5() {
     this->cvc5.emplace();
     // TODO: Conditionally use HO_AUFBV
     this->cvc5->setLogic("HO_ALL");
-    this->cvc5->setOption("tlimit-per", to_string(timeout_ms));
+    setCVC5Limits();
     this->cvc5->setOption("produce-models", "true");
   }
 
@@ -107,19 +141,46 @@ public:
   }
 #endif // SOLVER_CVC5
 
+  // Solvers that are created afterwards use the new limits.
+  void setLimits(uint64_t ms, bool rlimit) {
+    timeout_ms = ms;
+    use_rlimit = rlimit;
+#ifdef SOLVER_Z3
+    if (this->z3)
+      setZ3Limits(*this->z3);
+#endif
+#ifdef SOLVER_CVC5
+    if (this->cvc5) {
+      try {
+        setCVC5Limits();
+      } catch (const cvc5::CVC5ApiException &) {
+        // Keep the old limit if cvc5 does not allow changing it anymore
+      }
+    }
+#endif
+  }
+
   string getFreshName(string prefix) {
     return prefix.append("#" + to_string(fresh_var_counter++));
   }
 };
 
-Context sctx;
+// The context that a thread uses unless a ContextScope selects another one
+thread_local Context defaultContext;
+thread_local Context *currentContext = nullptr;
+thread_local chrono::steady_clock::duration simplify_time(0);
+
+Context &sctx() {
+  return currentContext ? *currentContext : defaultContext;
+}
 
 void releaseResources() {
+  sctx().fn_definitions.clear();
 #ifdef SOLVER_Z3
-  sctx.z3.reset();
+  sctx().z3.reset();
 #endif
 #ifdef SOLVER_CVC5
-  sctx.cvc5.reset();
+  sctx().cvc5.reset();
 #endif
 }
 
@@ -249,17 +310,17 @@ FnDecl::FnDecl(
     const Sort &range,
     string &&name): range(range) {
   IF_Z3_ENABLED(if (range.z3) {
-    z3 = sctx.z3->function(name.c_str(), toZ3SortVector(domain), *range.z3);
+    z3 = sctx().z3->function(name.c_str(), toZ3SortVector(domain), *range.z3);
   });
   IF_CVC5_ENABLED(if (range.cvc5) {
-    cvc5 = sctx.cvc5->declareFun(name, toCVC5SortVector(domain), *range.cvc5);
+    cvc5 = sctx().cvc5->declareFun(name, toCVC5SortVector(domain), *range.cvc5);
   });
 }
 
 Expr FnDecl::apply(const std::vector<Expr> &args) const {
   Expr e;
   SET_Z3(e, fmap(z3, [&args](auto &s) { return s(toZ3ExprVector(args)); }));
-  SET_CVC5(e, fupdate2(sctx.cvc5, cvc5, [&args](auto &solver, auto fdecl) {
+  SET_CVC5(e, fupdate2(sctx().cvc5, cvc5, [&args](auto &solver, auto fdecl) {
     auto args_cvc5 = toCVC5TermVector(args);
     args_cvc5.insert(args_cvc5.begin(), fdecl);
     return solver.mkTerm(cvc5::Kind::APPLY_UF, args_cvc5);
@@ -301,6 +362,70 @@ bool Expr::isConstantCVC5Term() const {
   return cvc5 && (cvc5->isIntegerValue() || cvc5->isBitVectorValue()
       || cvc5->isBooleanValue() || cvc5->isFloatingPointValue());
 }
+
+// Visit every subterm of terms once. Stops early if visit returns false.
+static void visitCVC5Terms(vector<cvc5::Term> &&terms,
+                           function<bool(const cvc5::Term &)> visit) {
+  unordered_set<uint64_t> visited;
+  while (!terms.empty()) {
+    auto t = std::move(terms.back());
+    terms.pop_back();
+    if (!visited.insert(t.getId()).second)
+      continue;
+    if (!visit(t))
+      return;
+    for (size_t i = 0; i < t.getNumChildren(); ++i)
+      terms.push_back(t[i]);
+  }
+}
+
+// Constants include uninterpreted functions
+static vector<cvc5::Term> getCVC5FreeConsts(vector<cvc5::Term> &&terms) {
+  vector<cvc5::Term> consts;
+  visitCVC5Terms(std::move(terms), [&consts](const cvc5::Term &t) {
+    if (t.getKind() == cvc5::Kind::CONSTANT)
+      consts.push_back(t);
+    return true;
+  });
+  return consts;
+}
+
+// True if t has no constants and quantifiers, so that simplify() gives its
+// value
+static bool isCVC5Ground(const cvc5::Term &t) {
+  bool ground = true;
+  visitCVC5Terms({t}, [&ground](const cvc5::Term &t) {
+    auto k = t.getKind();
+    ground = k != cvc5::Kind::CONSTANT && k != cvc5::Kind::FORALL &&
+             k != cvc5::Kind::EXISTS;
+    return ground;
+  });
+  return ground;
+}
+
+// Term and Sort print themselves in SMT-LIB2 syntax, quoting the symbols if
+// necessary
+static string toCVC5Script(const vector<cvc5::Term> &assertions) {
+  string script = "(set-logic HO_ALL)\n";
+  for (auto &c: getCVC5FreeConsts(vector(assertions))) {
+    auto sort = c.getSort();
+    string domain;
+    if (sort.isFunction()) {
+      for (auto &d: sort.getFunctionDomainSorts())
+        domain += (domain.empty() ? "" : " ") + d.toString();
+      sort = sort.getFunctionCodomainSort();
+    }
+    script += "(declare-fun " + c.toString() + " (" + domain + ") " +
+        sort.toString() + ")\n";
+  }
+  for (auto &a: assertions)
+    script += "(assert " + a.toString() + ")\n";
+  return script + "(check-sat)\n";
+}
+
+string Expr::toCVC5Script() const {
+  return ::smt::toCVC5Script({*cvc5});
+}
 #endif // SOLVER_CVC5
 
 void Expr::lockOps() {
@@ -312,11 +437,13 @@ void Expr::unlockOps() {
 }
 
 Expr Expr::simplify() const {
+  auto startTime = chrono::steady_clock::now();
   Expr e;
   SET_Z3(e, fmap(this->z3, [](auto e) { return e.simplify(); }));
-  SET_CVC5(e, fupdate2(sctx.cvc5, this->cvc5, [](auto &ctx, auto e) {
+  SET_CVC5(e, fupdate2(sctx().cvc5, this->cvc5, [](auto &ctx, auto e) {
     return ctx.simplify(e);
   }));
+  simplify_time += chrono::steady_clock::now() - startTime;
   return e;
 }
 
@@ -327,6 +454,45 @@ Sort Expr::sort() const {
   return s;
 }
 
+uint64_t Expr::dagSize() const {
+  unordered_set<uint64_t> visited;
+#ifdef SOLVER_Z3
+  if (this->z3) {
+    vector<z3::expr> worklist = {*this->z3};
+    while (!worklist.empty()) {
+      auto e = worklist.back();
+      worklist.pop_back();
+      if (!visited.insert(e.id()).second)
+        continue;
+
+      if (e.is_app()) {
+        for (unsigned i = 0; i < e.num_args(); ++i)
+          worklist.push_back(e.arg(i));
+      } else if (e.is_quantifier()) {
+        worklist.push_back(e.body());
+      }
+    }
+    return visited.size();
+  }
+#endif // SOLVER_Z3
+
+#ifdef SOLVER_CVC5
+  if (this->cvc5) {
+    vector<cvc5::Term> worklist = {*this->cvc5};
+    while (!worklist.empty()) {
+      auto t = worklist.back();
+      worklist.pop_back();
+      if (!visited.insert(t.getId()).second)
+        continue;
+
+      for (size_t i = 0; i < t.getNumChildren(); ++i)
+        worklist.push_back(t[i]);
+    }
+  }
+#endif // SOLVER_CVC5
+  return visited.size();
+}
+
 unsigned Expr::bitwidth() const {
   return sort().bitwidth();
 }
@@ -442,9 +608,9 @@ bool Expr::hasQuantifier() const {
     if (!e.is_app()) return false;
 
     Z3_app a = e;
-    for (unsigned i = 0; i < Z3_get_app_num_args(*sctx.z3, a); i++) {
+    for (unsigned i = 0; i < Z3_get_app_num_args(*sctx().z3, a); i++) {
       Expr newe = Expr();
-      newe.setZ3(z3::expr(*sctx.z3, Z3_get_app_arg(*sctx.z3, a, i)));
+      newe.setZ3(z3::expr(*sctx().z3, Z3_get_app_arg(*sctx().z3, a, i)));
       if (newe.hasQuantifier())
         return true;
     }
@@ -492,7 +658,7 @@ Expr Expr:: NAME (uint64_t arg) const {\
   }))
 
 #define SET_CVC5_USEOP(e, rhs, op) \
-  SET_CVC5(e, fupdate2(sctx.cvc5, this->cvc5, [&rhs](auto &solver, auto e2) { \
+  SET_CVC5(e, fupdate2(sctx().cvc5, this->cvc5, [&rhs](auto &solver, auto e2) { \
     return solver.mkTerm(cvc5::Kind::op, {e2, *rhs.cvc5}); \
   }))
 
@@ -674,6 +840,18 @@ Expr Expr::select(const vector<Expr> &idxs) const {
     return *elem;
   }
 
+  optional<Expr> arr, storedIdx;
+  if (idxs.size() == 1 &&
+      Store(Any(arr), Any(storedIdx), Any(elem)).match(*this)) {
+    auto idxEq = *storedIdx == idxs[0];
+    // select(store(arr, i, v), i) -> v
+    if (idxEq.isTrue())
+      return *elem;
+    // select(store(arr, i, v), j) -> select(arr, j) if i != j
+    else if (idxEq.isFalse())
+      return arr->select(idxs);
+  }
+
   Expr e;
 
   SET_Z3(e, fmap(this->z3, [&idxs](auto e) {
@@ -687,7 +865,7 @@ Expr Expr::select(const vector<Expr> &idxs) const {
   }
 #endif // SOLVER_Z3
 
-  SET_CVC5(e, fupdate2(sctx.cvc5, this->cvc5,
+  SET_CVC5(e, fupdate2(sctx().cvc5, this->cvc5,
       [&idxs](auto &solver, auto e) {
     if (e.getSort().isArray()) {
       assert(idxs.size() == 1);
@@ -713,23 +891,32 @@ Expr Expr::select(const vector<Expr> &idxs) const {
 #ifdef SOLVER_CVC5
 static cvc5::Term mkCVC5Lambda(
     const cvc5::Term &var, const cvc5::Term &body) {
-  auto vlist = sctx.cvc5->mkTerm(cvc5::Kind::VARIABLE_LIST, {var});
-  return sctx.cvc5->mkTerm(cvc5::Kind::LAMBDA, {vlist, body});
+  auto vlist = sctx().cvc5->mkTerm(cvc5::Kind::VARIABLE_LIST, {var});
+  return sctx().cvc5->mkTerm(cvc5::Kind::LAMBDA, {vlist, body});
 }
 
 // Convert arr to lambda idx, arr idx
 static cvc5::Term toCVC5Lambda(const cvc5::Term &arr) {
-  auto idx = sctx.cvc5->mkVar(arr.getSort().getArrayIndexSort());
-  return mkCVC5Lambda(idx, sctx.cvc5->mkTerm(cvc5::Kind::SELECT, {arr, idx}));
+  auto idx = sctx().cvc5->mkVar(arr.getSort().getArrayIndexSort());
+  return mkCVC5Lambda(idx, sctx().cvc5->mkTerm(cvc5::Kind::SELECT, {arr, idx}));
 }
 #endif // SOLVER_CVC5
 
 Expr Expr::store(const Expr &idx, const Expr &val) const {
+  {
+    using namespace matchers;
+    optional<Expr> arr, storedIdx, dummy;
+    // store(store(arr, i, v), i, w) -> store(arr, i, w)
+    if (Store(Any(arr), Any(storedIdx), Any(dummy)).match(*this) &&
+        storedIdx->isIdentical(idx))
+      return arr->store(idx, val);
+  }
+
   Expr e;
   SET_Z3(e, fmap(this->z3, [&idx, &val](auto e) {
     return z3::store(e, *idx.z3, *val.z3);
   }));
-  SET_CVC5(e, fupdate2(sctx.cvc5, this->cvc5,
+  SET_CVC5(e, fupdate2(sctx().cvc5, this->cvc5,
       [&idx, &val](auto &solver, auto e) { // e: array or lambda
     if (e.getSort().isArray())
       return solver.mkTerm(cvc5::Kind::STORE, {e, *idx.cvc5, *val.cvc5});
@@ -759,7 +946,7 @@ Expr Expr::insert(const Expr &elem) const {
     auto idx = *elem.z3;
     return z3::store(arrayz3, idx, z3::select(arrayz3, idx) + 1);
   }));
-  SET_CVC5(e, fupdate(sctx.cvc5, [&](auto &solver) {
+  SET_CVC5(e, fupdate(sctx().cvc5, [&](auto &solver) {
     auto newBag = solver.mkTerm(cvc5::Kind::BAG_MAKE, {*elem.cvc5, solver.mkInteger(1)});
     return solver.mkTerm(cvc5::Kind::BAG_UNION_DISJOINT, {*cvc5, newBag});
   }));
@@ -770,14 +957,14 @@ Expr Expr::bagUnion(const Expr &other) const {
   CHECK_LOCK2(other);
     Expr e;
   // Z3 doesn't support multisets. We encode it using a const array.
-  SET_Z3(e, fupdate2(sctx.z3, z3, [&](auto &ctx, auto &arrayz3) {
+  SET_Z3(e, fupdate2(sctx().z3, z3, [&](auto &ctx, auto &arrayz3) {
     auto domain = arrayz3.get_sort().array_domain();
     auto idx = ctx.constant("idx", domain);
     auto lhs = z3::select(arrayz3, idx);
     auto rhs = z3::select(*other.z3, idx);
     return z3::lambda(idx, lhs + rhs);
   }));
-  SET_CVC5(e, fupdate(sctx.cvc5, [&](auto &solver) {
+  SET_CVC5(e, fupdate(sctx().cvc5, [&](auto &solver) {
     return solver.mkTerm(cvc5::Kind::BAG_UNION_DISJOINT, {*cvc5, *other.cvc5});
   }));
   return e;
@@ -827,7 +1014,7 @@ Expr Expr::extract(unsigned hbit, unsigned lbit) const {
   SET_Z3(e, fmap(this->z3, [&hbit, &lbit](auto e) {
     return e.extract(hbit, lbit); 
   }));
-  SET_CVC5(e, fupdate2(sctx.cvc5, this->cvc5,
+  SET_CVC5(e, fupdate2(sctx().cvc5, this->cvc5,
       [hbit, lbit](auto &solver, auto e) {
     return solver.mkTerm(
         solver.mkOp(cvc5::Kind::BITVECTOR_EXTRACT, {hbit, lbit}), {e});
@@ -853,7 +1040,7 @@ Expr Expr::zext(unsigned bits) const {
 
   Expr e;
   SET_Z3_USEOP_CONST(e, bits, zext);
-  SET_CVC5(e, fupdate2(sctx.cvc5, this->cvc5,
+  SET_CVC5(e, fupdate2(sctx().cvc5, this->cvc5,
       [&bits](auto &solver, auto e) {
     return solver.mkTerm(
       solver.mkOp(cvc5::Kind::BITVECTOR_ZERO_EXTEND, {bits}), {e});
@@ -866,7 +1053,7 @@ Expr Expr::sext(unsigned bits) const {
 
   Expr e;
   SET_Z3_USEOP_CONST(e, bits, sext);
-  SET_CVC5(e, fupdate2(sctx.cvc5, this->cvc5,
+  SET_CVC5(e, fupdate2(sctx().cvc5, this->cvc5,
       [&bits](auto &solver, auto e) {
     return solver.mkTerm(
       solver.mkOp(cvc5::Kind::BITVECTOR_SIGN_EXTEND, {bits}), {e});
@@ -933,6 +1120,19 @@ Expr Expr::operator+(const Expr &rhs) const {
     return *this;
 
   using namespace matchers;
+  {
+    optional<Expr> x, c;
+    uint64_t cval;
+    // (x + c1) + c2 -> x + (c1 + c2)
+    if (rhs.isUInt(b) && Add(Any(x), Any(c)).match(*this) &&
+        c->isUInt(cval) && rhs.bitwidth() <= 64)
+      return *x + mkBV(cval + b, rhs.bitwidth());
+    // c1 + (x + c2) -> x + (c1 + c2)
+    else if (isUInt(a) && Add(Any(x), Any(c)).match(rhs) &&
+             c->isUInt(cval) && rhs.bitwidth() <= 64)
+      return *x + mkBV(a + cval, rhs.bitwidth());
+  }
+
   {
     optional<Expr> a, b, b2, a2, b3;
     // ((a / b) * b) + (a % b) -> a
@@ -962,6 +1162,18 @@ Expr Expr::operator-(const Expr &rhs) const {
     return mkBV(a - b, rhs.bitwidth());
   else if (rhs.isUInt(b) && b == 0)
     return *this;
+  else if (isIdentical(rhs) && sort().isBV())
+    return mkBV(0, rhs.bitwidth());
+
+  if (rhs.isUInt(b)) {
+    using namespace matchers;
+    optional<Expr> x, c;
+    uint64_t cval;
+    // (x + c1) - c2 -> x + (c1 - c2)
+    if (Add(Any(x), Any(c)).match(*this) && c->isUInt(cval) &&
+        rhs.bitwidth() <= 64)
+      return *x + mkBV(cval - b, rhs.bitwidth());
+  }
 
   Expr e;
   SET_Z3_USEOP(e, rhs, operator-);
@@ -1145,7 +1357,7 @@ Expr Expr::operator~() const {
 
   Expr e;
   SET_Z3(e, fmap(this->z3, [&](auto e) { return ~e; }));
-  SET_CVC5(e, fupdate2(sctx.cvc5, this->cvc5, [&](auto &solver, auto e2) { \
+  SET_CVC5(e, fupdate2(sctx().cvc5, this->cvc5, [&](auto &solver, auto e2) { \
     return solver.mkTerm(cvc5::Kind::BITVECTOR_NOT, {e2}); \
   }));
   return e;
@@ -1262,6 +1474,115 @@ Expr Expr::substitute(
   return e;
 }
 
+#ifdef SOLVER_Z3
+namespace {
+// Replaces the applications of defined functions in a z3 expr. Binders are
+// opened with fresh constants, so the arguments of an application never have
+// loose bound variables when they are substituted into a body.
+class Z3DefinitionExpander {
+  z3::context &ctx;
+  // func_decl id -> (params, body)
+  const map<unsigned, pair<z3::expr_vector, z3::expr>> &defs;
+  // ast id -> (expr, expansion); expr is kept so that its id is not reused
+  unordered_map<unsigned, pair<z3::expr, z3::expr>> cache;
+
+  z3::expr expandApp(const z3::expr &e) {
+    z3::expr_vector args(ctx);
+    bool changed = false;
+    for (unsigned i = 0; i < e.num_args(); ++i) {
+      auto arg = e.arg(i);
+      auto newArg = expand(arg);
+      changed |= !z3::eq(arg, newArg);
+      args.push_back(newArg);
+    }
+
+    auto decl = e.decl();
+    auto def = defs.find(decl.id());
+    if (def != defs.end()) {
+      auto body = def->second.second;
+      return body.substitute(def->second.first, args);
+    }
+    return changed ? decl(args) : e;
+  }
+
+  z3::expr expandBinder(const z3::expr &e) {
+    unsigned n = Z3_get_quantifier_num_bound(ctx, e);
+    z3::expr_vector vars(ctx), deBruijnVars(ctx);
+    for (unsigned i = 0; i < n; ++i) {
+      z3::sort sort(ctx, Z3_get_quantifier_bound_sort(ctx, e, i));
+      vars.push_back(ctx.constant(sctx().getFreshName("bound").c_str(), sort));
+    }
+    // The last bound variable has de Bruijn index 0
+    for (unsigned i = n; i > 0; --i)
+      deBruijnVars.push_back(vars[i - 1]);
+
+    auto body = e.body().substitute(deBruijnVars);
+    auto newBody = expand(body);
+    if (z3::eq(body, newBody))
+      return e;
+    else if (e.is_lambda())
+      return z3::lambda(vars, newBody);
+    else if (e.is_forall())
+      return z3::forall(vars, newBody);
+    return z3::exists(vars, newBody);
+  }
+
+public:
+  Z3DefinitionExpander(z3::context &ctx,
+      const map<unsigned, pair<z3::expr_vector, z3::expr>> &defs):
+    ctx(ctx), defs(defs) {}
+
+  z3::expr expand(const z3::expr &e) {
+    if (!e.is_app() && !e.is_quantifier())
+      return e;
+
+    auto itr = cache.find(e.id());
+    if (itr != cache.end())
+      return itr->second.second;
+
+    auto res = e.is_app() ? expandApp(e) : expandBinder(e);
+    cache.emplace(e.id(), make_pair(e, res));
+    return res;
+  }
+};
+}
+#endif // SOLVER_Z3
+
+Expr Expr::expandDefinitions() const {
+  auto &defs = sctx().fn_definitions;
+  if (defs.empty())
+    return *this;
+
+  Expr e;
+#ifdef SOLVER_Z3
+  if (this->z3) {
+    map<unsigned, pair<z3::expr_vector, z3::expr>> z3defs;
+    for (auto &def: defs) {
+      z3defs.emplace(def.fn.z3->id(),
+          make_pair(toZ3ExprVector(def.params), *def.body.z3));
+    }
+    e.setZ3(Z3DefinitionExpander(*sctx().z3, z3defs).expand(*this->z3));
+  }
+#endif // SOLVER_Z3
+
+#ifdef SOLVER_CVC5
+  e.setCVC5(fupdate2(sctx().cvc5, this->cvc5, [&defs](auto &solver, auto t) {
+    // Substituting a function with a lambda beta-reduces its applications
+    vector<cvc5::Term> fns, lambdas;
+    for (auto &def: defs) {
+      auto vlist = solver.mkTerm(cvc5::Kind::VARIABLE_LIST,
+                                 toCVC5TermVector(def.params));
+      fns.push_back(*def.fn.cvc5);
+      lambdas.push_back(
+          solver.mkTerm(cvc5::Kind::LAMBDA, {vlist, *def.body.cvc5}));
+    }
+    return t.substitute(fns, lambdas);
+  }));
+#endif // SOLVER_CVC5
+
+  return e;
+}
+
 #ifdef SOLVER_Z3
 Expr Expr::substituteDeBruijn(const std::vector<Expr> &values) const {
   Expr e;
@@ -1292,13 +1613,20 @@ bool Expr::isIdentical(const Expr &e2, bool is_or) const {
   return res;
 }
 
+size_t Expr::hash() const {
+  size_t h = 0;
+  IF_Z3_ENABLED(if (z3) h = z3->hash());
+  IF_CVC5_ENABLED(if (cvc5) h = h * 31 + std::hash<cvc5::Term>()(*cvc5));
+  return h;
+}
+
 Expr Expr::mkFreshVar(const Sort &s, const std::string &prefix) {
   Expr e;
-  SET_Z3(e, fupdate2(sctx.z3, s.z3, [&prefix](auto &ctx, auto &z3sort){
+  SET_Z3(e, fupdate2(sctx().z3, s.z3, [&prefix](auto &ctx, auto &z3sort){
     return z3::expr(ctx, Z3_mk_fresh_const(ctx, prefix.data(), z3sort));
   }));
-  SET_CVC5(e, fupdate2(sctx.cvc5, s.cvc5, [&prefix](auto &ctx, auto &cvc5sort){
-    return ctx.mkConst(cvc5sort, sctx.getFreshName(prefix));
+  SET_CVC5(e, fupdate2(sctx().cvc5, s.cvc5, [&prefix](auto &ctx, auto &cvc5sort){
+    return ctx.mkConst(cvc5sort, sctx().getFreshName(prefix));
   }));
   return e;
 }
@@ -1309,21 +1637,21 @@ Expr Expr::mkFreshVar(const Expr &sort_of, const std::string &prefix) {
 
 Expr Expr::mkVar(const Sort &s, const std::string &name, bool boundVar) {
   Expr e;
-  SET_Z3(e, fupdate2(sctx.z3, s.z3, [&name](auto &ctx, auto &sortz3){
+  SET_Z3(e, fupdate2(sctx().z3, s.z3, [&name](auto &ctx, auto &sortz3){
     return ctx.constant(name.data(), sortz3);
   }));
-  SET_CVC5(e, fupdate2(sctx.cvc5, s.cvc5,
+  SET_CVC5(e, fupdate2(sctx().cvc5, s.cvc5,
       [&name, &boundVar](auto &ctx, auto &cvc5sort){
-    if (!sctx.getNamedTerm(name).has_value()) {
+    if (!sctx().getNamedTerm(name).has_value()) {
       cvc5::Term new_var;
       if (boundVar)
         new_var = ctx.mkVar(cvc5sort, name);
       else
         new_var = ctx.mkConst(cvc5sort, name);
-      sctx.addNamedTerm(name, std::move(new_var));
+      sctx().addNamedTerm(name, std::move(new_var));
     }
 
-    const auto term = *sctx.getNamedTerm(name);
+    const auto term = *sctx().getNamedTerm(name);
     smart_assert((boundVar && term.getKind() == cvc5::Kind::VARIABLE) ||
                  (!boundVar && term.getKind() == cvc5::Kind::CONSTANT),
                  "Boundness does not match");
@@ -1340,10 +1668,10 @@ Expr Expr::mkVar(const Expr &sort_of, const std::string &name, bool boundVar) {
 
 Expr Expr::mkBV(const uint64_t val, const size_t sz) {
   Expr e;
-  SET_Z3(e, fupdate(sctx.z3, [val, sz](auto &ctx){
+  SET_Z3(e, fupdate(sctx().z3, [val, sz](auto &ctx){
     return ctx.bv_val(val, sz); 
   }));
-  SET_CVC5(e, fupdate(sctx.cvc5, [val, sz](auto &ctx){
+  SET_CVC5(e, fupdate(sctx().cvc5, [val, sz](auto &ctx){
     return ctx.mkBitVector(sz, val);
   }));
   return e;
@@ -1355,10 +1683,10 @@ Expr Expr::mkBV(const uint64_t val, const Expr &sort_of) {
 
 Expr Expr::mkBool(const bool val) {
   Expr e;
-  SET_Z3(e, fupdate(sctx.z3, [val](auto &ctx){
+  SET_Z3(e, fupdate(sctx().z3, [val](auto &ctx){
     return ctx.bool_val(val); 
   }));
-  SET_CVC5(e, fupdate(sctx.cvc5, [val](auto &ctx){
+  SET_CVC5(e, fupdate(sctx().cvc5, [val](auto &ctx){
     return ctx.mkBoolean(val);
   }));
   return e;
@@ -1366,7 +1694,7 @@ Expr Expr::mkBool(const bool val) {
 
 Expr Expr::mkFpaVal(const float val) {
   Expr e;
-  SET_Z3(e, fupdate(sctx.z3, [val](auto &ctx){
+  SET_Z3(e, fupdate(sctx().z3, [val](auto &ctx){
     return ctx.fpa_val(val);
   }));
   return e;
@@ -1374,7 +1702,7 @@ Expr Expr::mkFpaVal(const float val) {
 
 Expr Expr::mkFpaVal(const double val) {
   Expr e;
-  SET_Z3(e, fupdate(sctx.z3, [val](auto &ctx){
+  SET_Z3(e, fupdate(sctx().z3, [val](auto &ctx){
     return ctx.fpa_val(val);
   }));
   return e;
@@ -1395,7 +1723,7 @@ Expr Expr::mkForall(const vector<Expr> &vars, const Expr &body) {
   SET_Z3(e, fmap(body.z3, [&](auto &z3body){
     return z3::forall(toZ3ExprVector(vars), z3body);
   }));
-  SET_CVC5(e, fupdate2(sctx.cvc5, body.cvc5, [&](auto &solver, auto cvc5body){
+  SET_CVC5(e, fupdate2(sctx().cvc5, body.cvc5, [&](auto &solver, auto cvc5body){
     auto cvc5vars = toCVC5TermVector(vars);
     auto vlist = solver.mkTerm(cvc5::Kind::VARIABLE_LIST, {cvc5vars});
     return solver.mkTerm(cvc5::Kind::FORALL, {vlist, cvc5body});
@@ -1420,7 +1748,21 @@ Expr Expr::mkLambda(const vector<Expr> &vars, const Expr &body) {
   SET_Z3(e, fmap(body.z3, [&](auto &z3body){
     return z3::lambda(toZ3ExprVector(vars), z3body);
   }));
-  SET_CVC5(e, fupdate2(sctx.cvc5, body.cvc5, [&](auto &solver, auto cvc5body){
+#ifdef SOLVER_Z3
+  // Lambdas and arrays have the same sort in Z3 only, so this is not done
+  // for CVC5. A constant body is not turned into a const array here because
+  // const arrays need the ALL logic (see State::hasConstArray); the callers
+  // that know the body is constant use mkSplatArray.
+  if (e.hasZ3Expr() && vars.size() == 1) {
+    using namespace matchers;
+    optional<Expr> arr, idx;
+    // lambda i, select(arr, i) -> arr
+    if (Select(Any(arr), Any(idx)).match(body) &&
+        idx->isIdentical(vars[0]) && arr->isVar())
+      e.setZ3(arr->getZ3Expr());
+  }
+#endif // SOLVER_Z3
+  SET_CVC5(e, fupdate2(sctx().cvc5, body.cvc5, [&](auto &solver, auto cvc5body){
     auto cvc5vars = toCVC5TermVector(vars);
     auto vlist = solver.mkTerm(cvc5::Kind::VARIABLE_LIST, cvc5vars);
     return solver.mkTerm(cvc5::Kind::LAMBDA, {vlist, cvc5body});
@@ -1435,8 +1777,8 @@ Expr Expr::mkSplatArray(const Sort &domain, const Expr &splatElem) {
   }));
 
 #ifdef SOLVER_CVC5
-  if (splatElem.cvc5 && sctx.cvc5) {
-    auto &solver = *sctx.cvc5;
+  if (splatElem.cvc5 && sctx().cvc5) {
+    auto &solver = *sctx().cvc5;
     auto &elem = *splatElem.cvc5;
     // TOOD: How to avoid this constant-ness check?
     if (elem.isIntegerValue() || elem.isFloatingPointValue() ||
@@ -1461,6 +1803,8 @@ Expr Expr::mkIte(const Expr &cond, const Expr &then, const Expr &els) {
     return cond | els;
   else if (els.isFalse())
     return cond & then;
+  else if (then.isIdentical(els))
+    return then;
 
   optional<Expr> lhs, rhs;
   using namespace matchers;
@@ -1471,11 +1815,21 @@ Expr Expr::mkIte(const Expr &cond, const Expr &then, const Expr &els) {
       return els;
   }
 
+  optional<Expr> innerCond, innerThen, innerEls;
+  // ite(c, ite(c, x, _), y) -> ite(c, x, y)
+  if (Ite(Any(innerCond), Any(innerThen), Any(innerEls)).match(then) &&
+      innerCond->isIdentical(cond))
+    return mkIte(cond, *innerThen, els);
+  // ite(c, x, ite(c, _, y)) -> ite(c, x, y)
+  if (Ite(Any(innerCond), Any(innerThen), Any(innerEls)).match(els) &&
+      innerCond->isIdentical(cond))
+    return mkIte(cond, then, *innerEls);
+
   Expr e;
   SET_Z3(e, fmap(cond.z3, [&](auto &condz3){
     return z3::ite(condz3, *then.z3, *els.z3);
   }));
-  SET_CVC5(e, fupdate2(sctx.cvc5, cond.cvc5, [&](auto &solver, auto condcvc) {
+  SET_CVC5(e, fupdate2(sctx().cvc5, cond.cvc5, [&](auto &solver, auto condcvc) {
     auto thenSort = then.cvc5->getSort();
     auto elsSort = els.cvc5->getSort();
     auto thenval = *then.cvc5, elsval = *els.cvc5;
@@ -1492,7 +1846,7 @@ Expr Expr::mkEmptyBag(const Sort &domain) {
   Expr e;
   // Z3 doesn't support multisets. We encode it using a const array.
   SET_Z3(e, Expr::mkSplatArray(domain, Index::zero()).z3);
-  SET_CVC5(e, fupdate2(sctx.cvc5, domain.cvc5, [&](auto &solver, auto domcvc) {
+  SET_CVC5(e, fupdate2(sctx().cvc5, domain.cvc5, [&](auto &solver, auto domcvc) {
     auto bag = solver.mkBagSort(domcvc);
     return solver.mkEmptyBag(bag);
   }));
@@ -1519,7 +1873,7 @@ Sort Sort::getArrayDomain() const {
   SET_Z3(s, fmap(z3, [&](const z3::sort &sz3) {
     return sz3.array_domain();
   }));
-  SET_CVC5(s, fupdate2(sctx.cvc5, cvc5, [&](auto &solver, auto cvc5sort) {
+  SET_CVC5(s, fupdate2(sctx().cvc5, cvc5, [&](auto &solver, auto cvc5sort) {
     if (cvc5sort.isFunction()) {
       auto dom = cvc5sort.getFunctionDomainSorts();
       assert(dom.size() == 1);
@@ -1546,7 +1900,7 @@ bool Sort::isBV() const {
 Sort Sort::toFnSort() const {
   Sort s;
   SET_Z3(s, fmap(z3, [](const auto &sz) { return sz; }));
-  SET_CVC5(s, fupdate2(sctx.cvc5, cvc5,
+  SET_CVC5(s, fupdate2(sctx().cvc5, cvc5,
       [](auto &solver, auto s) {
     if (s.isArray()) {
       return solver.mkFunctionSort(
@@ -1580,25 +1934,25 @@ bool Sort::isBool() const {
 
 Sort Sort::bvSort(size_t bw) {
   Sort s;
-  SET_Z3(s, fupdate(sctx.z3, [bw](auto &ctx){ return ctx.bv_sort(bw); }));
-  SET_CVC5(s, fupdate(sctx.cvc5, [bw](auto &ctx){
+  SET_Z3(s, fupdate(sctx().z3, [bw](auto &ctx){ return ctx.bv_sort(bw); }));
+  SET_CVC5(s, fupdate(sctx().cvc5, [bw](auto &ctx){
       return ctx.mkBitVectorSort(bw); }));
   return s;
 }
 
 Sort Sort::boolSort() {
   Sort s;
-  SET_Z3(s, fupdate(sctx.z3, [](auto &ctx){ return ctx.bool_sort(); }));
-  SET_CVC5(s, fupdate(sctx.cvc5, [](auto &c){ return c.getBooleanSort(); }));
+  SET_Z3(s, fupdate(sctx().z3, [](auto &ctx){ return ctx.bool_sort(); }));
+  SET_CVC5(s, fupdate(sctx().cvc5, [](auto &c){ return c.getBooleanSort(); }));
   return s;
 }
 
 Sort Sort::arraySort(const Sort &domain, const Sort &range) {
   Sort s;
-  SET_Z3(s, fupdate2(sctx.z3, domain.z3, [&range](auto &ctx, auto domz3){
+  SET_Z3(s, fupdate2(sctx().z3, domain.z3, [&range](auto &ctx, auto domz3){
     return ctx.array_sort(domz3, *range.z3);
   }));
-  SET_CVC5(s, fupdate2(sctx.cvc5, domain.cvc5,
+  SET_CVC5(s, fupdate2(sctx().cvc5, domain.cvc5,
       [&range](auto &ctx, auto domcvc5){
         return ctx.mkArraySort(domcvc5, *range.cvc5);
     }
@@ -1608,13 +1962,13 @@ Sort Sort::arraySort(const Sort &domain, const Sort &range) {
 
 Sort Sort::fp32IEEE754Sort() {
   Sort s;
-  SET_Z3(s, fupdate(sctx.z3, [](auto &ctx){ return ctx.fpa_sort(8, 24); })); // f32
+  SET_Z3(s, fupdate(sctx().z3, [](auto &ctx){ return ctx.fpa_sort(8, 24); })); // f32
   return s;
 }
 
 Sort Sort::fp64IEEE754Sort() {
   Sort s;
-  SET_Z3(s, fupdate(sctx.z3, [](auto &ctx){ return ctx.fpa_sort(11, 53); })); // f64
+  SET_Z3(s, fupdate(sctx().z3, [](auto &ctx){ return ctx.fpa_sort(11, 53); })); // f64
   return s;
 }
 
@@ -1625,14 +1979,14 @@ bool CheckResult::isUnknown() const {
 }
 
 bool CheckResult::hasSat() const {
-  bool res = false;
+  bool res = (cachedSat && *cachedSat) || (externalSat && *externalSat);
   IF_Z3_ENABLED(res |= z3 && (*z3 == z3::check_result::sat));
   IF_CVC5_ENABLED(res |= cvc5 && cvc5->isSat());
   return res;
 }
 
 bool CheckResult::hasUnsat() const {
-  bool res = false;
+  bool res = (cachedSat && !*cachedSat) || (externalSat && !*externalSat);
   IF_Z3_ENABLED(res |= z3 && (*z3 == z3::check_result::unsat));
   IF_CVC5_ENABLED(res |= cvc5 && cvc5->isUnsat());
   return res;
@@ -1642,34 +1996,85 @@ bool CheckResult::isInconsistent() const {
   return hasSat() && hasUnsat();
 }
 
+optional<uint64_t> CheckResult::getResourceUnits(SolverType s) const {
+  if (s == SolverType::Z3)
+    return z3ResourceUnits;
+  else if (s == SolverType::CVC5)
+    return cvc5ResourceUnits;
+  return nullopt;
+}
+
+CheckResult CheckResult::fromCache(bool isSat) {
+  CheckResult cr;
+  cr.cachedSat = isSat;
+  return cr;
+}
+
 // ------- Model -------
 
-Expr Model::eval(const Expr &e, bool modelCompletion) const {
+#ifdef SOLVER_CVC5
+vector<cvc5::Term> Model::evalCVC5(
+    cvc5::Solver &solver, const vector<cvc5::Term> &es) const {
+  vector<cvc5::Term> values(es.size());
+  vector<cvc5::Term> uncovered;
+  vector<size_t> uncoveredIdxs;
+  for (size_t i = 0; i < es.size(); ++i) {
+    if (cvc5_values) {
+      auto v = solver.simplify(es[i].substitute(cvc5_consts, *cvc5_values));
+      if (isCVC5Ground(v)) {
+        values[i] = std::move(v);
+        continue;
+      }
+    }
+    uncovered.push_back(es[i]);
+    uncoveredIdxs.push_back(i);
+  }
+  if (uncovered.empty())
+    return values;
+
+  // The expressions have constants that the query does not have.
+  // getValue() creates a new BV, so the model gets invalidated
+  // re-running checkSat() is very expensive, but this is so far
+  // the only way to retrieve the values. It is run once for all of them.
+  verbose("Model::eval") << "solve the query again to evaluate "
+                         << uncovered.size() << " expressions\n";
+  solver.checkSatAssuming(cvc5_assumptions);
+  auto uncoveredValues = solver.getValue(uncovered);
+  for (size_t i = 0; i < uncoveredIdxs.size(); ++i)
+    values[uncoveredIdxs[i]] = std::move(uncoveredValues[i]);
+  return values;
+}
+#endif // SOLVER_CVC5
+
+Expr Model::eval(const Expr &e0, bool modelCompletion) const {
+  Expr e = e0.expandDefinitions();
   Expr newe;
   SET_Z3(newe, fmap(z3, [modelCompletion, &e](auto &z3model){
     return z3model.eval(e.getZ3Expr(), modelCompletion);
   }));
-  SET_CVC5(newe, fupdate2(sctx.cvc5, e.cvc5, [](auto &solver, auto ec){
-    // getValue() creates a new BV, so the model gets invalidated
-    // re-running checkSat() is very expensive, but this is so far
-    // the only way to retrieve the values
-    solver.checkSat();
-    return solver.getValue(ec);
+  SET_CVC5(newe, fupdate2(sctx().cvc5, e.cvc5, [this](auto &solver, auto ec){
+    return evalCVC5(solver, {ec})[0];
   }));
 
   return newe;
 }
 
-vector<Expr> Model::eval(const vector<Expr> &exprs, bool modelCompletion) const {
+vector<Expr> Model::eval(const vector<Expr> &exprs0, bool modelCompletion) const {
+  vector<Expr> exprs;
+  exprs.reserve(exprs0.size());
+  for (auto &e: exprs0)
+    exprs.push_back(e.expandDefinitions());
+
   vector<Expr> values;
   values.reserve(exprs.size());
 
 #ifdef SOLVER_CVC5
-  auto cvc5_values = fupdate(sctx.cvc5, [exprs](auto &solver) {
-    // see the comment at Expr Model::eval(const Expr &e, bool modelCompletion)
-    solver.checkSat();
-    auto cvc5_exprs = toCVC5TermVector(exprs);
-    return solver.getValue(cvc5_exprs);
+  auto cvc5_values = fupdate(sctx().cvc5, [this, &exprs](auto &solver) {
+    vector<cvc5::Term> terms;
+    terms.reserve(exprs.size());
+    for (auto &e: exprs)
+      terms.push_back(e.getCVC5Term());
+    return evalCVC5(solver, terms);
   });
 #endif // SOLVER_CVC5
 
@@ -1700,23 +2105,93 @@ vector<Expr> Model::eval(const vector<Expr> &exprs, bool modelCompletion) const
 Model Model::empty() {
   // FIXME
   Model m;
-  SET_Z3(m, {*sctx.z3});
+  SET_Z3(m, {*sctx().z3});
   return m;
 }
 
 // ------- Solver -------
 
-Solver::Solver(const char *logic) {
 #ifdef SOLVER_Z3
-  z3 = fupdate(sctx.z3, [logic](auto &ctx){
+namespace {
+struct Z3Tactic {
+  string logic;
+  string step;
+  string pipeline;
+};
+vector<Z3Tactic> z3Tactics;
+}
+
+static z3::tactic makeZ3Tactic(z3::context &ctx, const string &pipeline) {
+  optional<z3::tactic> t;
+  size_t begin = 0;
+  while (begin <= pipeline.size()) {
+    size_t end = min(pipeline.find('+', begin), pipeline.size());
+    z3::tactic next(ctx, pipeline.substr(begin, end - begin).c_str());
+    t = t ? *t & next : next;
+    begin = end + 1;
+  }
+  return *t;
+}
+
+static optional<string> findZ3Tactic(const string &logic, const string &step) {
+  for (auto itr = z3Tactics.rbegin(); itr != z3Tactics.rend(); ++itr) {
+    if ((itr->logic == "*" || itr->logic == logic) &&
+        (itr->step == "*" || itr->step == step))
+      return itr->pipeline;
+  }
+  return nullopt;
+}
+#endif // SOLVER_Z3
+
+bool addZ3Tactic(const string &logic, const string &step,
+                 const string &pipeline, string &err) {
+#ifdef SOLVER_Z3
+  try {
+    z3::context ctx;
+    makeZ3Tactic(ctx, pipeline);
+  } catch (const z3::exception &e) {
+    err = e.msg();
+    return false;
+  }
+  z3Tactics.push_back({logic, step, pipeline});
+  return true;
+#else
+  err = "Z3 is not enabled";
+  return false;
+#endif
+}
+
+void clearZ3Tactics() {
+  IF_Z3_ENABLED(z3Tactics.clear());
+}
+
+bool hasZ3StepTactics() {
+#ifdef SOLVER_Z3
+  for (auto &t: z3Tactics) {
+    if (t.step != "*")
+      return true;
+  }
+#endif
+  return false;
+}
+
+Solver::Solver(const char *logic, const string &step): logic(logic) {
+#ifdef SOLVER_Z3
+  z3 = fupdate(sctx().z3, [logic, &step](auto &ctx){
+    if (auto pipeline = findZ3Tactic(logic, step)) {
+      verbose("Solver") << "Z3 tactic for " << logic << ":" << step << ": "
+                        << *pipeline << "\n";
+      auto t = makeZ3Tactic(ctx, *pipeline) | z3::tactic(ctx, "default");
+      return t.mk_solver();
+    }
     return z3::solver(ctx, logic);
   });
 #endif // SOLVER_Z3
 #ifdef SOLVER_CVC5
   // We can't create new solver since it won't be compatible with
   // the variables created by previous solver
-  if (sctx.cvc5)
-    sctx.cvc5->push();
+  if (sctx().cvc5)
+    sctx().cvc5->push();
 #endif // SOLVER_CVC5
 }
 
@@ -1724,9 +2199,9 @@ Solver::~Solver() {
 #ifdef SOLVER_CVC5
   // We can't destroy solver since it will invalidate every variable
   // it has created
-  if (sctx.cvc5) {
-    sctx.clearCachedTerms();
-    sctx.cvc5->pop();
+  if (sctx().cvc5) {
+    sctx().clearCachedTerms();
+    sctx().cvc5->pop();
   }
 #endif // SOLVER_CVC5
 }
@@ -1736,7 +2211,7 @@ void Solver::add(const Expr &e) {
     solver.add(*e.z3);
     return 0;
   }));
-  IF_CVC5_ENABLED(fupdate(sctx.cvc5, [&e](auto &solver) {
+  IF_CVC5_ENABLED(fupdate(sctx().cvc5, [&e](auto &solver) {
     solver.assertFormula(*e.cvc5);
     return 0;
   }));
@@ -1744,32 +2219,436 @@ void Solver::add(const Expr &e) {
 
 void Solver::reset() {
   IF_Z3_ENABLED(fupdate(z3, [](auto &solver) { solver.reset(); return 0; }));
-  IF_CVC5_ENABLED(fupdate(sctx.cvc5, [](auto &solver) {
+  IF_CVC5_ENABLED(fupdate(sctx().cvc5, [](auto &solver) {
     solver.resetAssertions();
     return 0;
   }));
 }
 
+static uint64_t getMsSince(chrono::steady_clock::time_point start) {
+  return chrono::duration_cast<chrono::milliseconds>(
+      chrono::steady_clock::now() - start).count();
+}
+
 CheckResult Solver::check() {
-  // TODO: concurrent run with solvers and return the fastest one?
+  return check(vector<Expr>());
+}
+
+CheckResult Solver::check(const vector<Expr> &assumptions) {
+  IF_CVC5_ENABLED(cvc5_assumptions = toCVC5TermVector(assumptions));
+  external_model.clear();
+
+  auto counts = getResourceCounts();
+  unique_ptr<extsolver::Process> ext;
+  if (extsolver::isEnabled())
+    ext = extsolver::Process::start(getExternalScript(assumptions));
+  if (!ext) {
+    auto cr = checkInProcess(assumptions);
+    setResourceUnits(cr, counts);
+    return cr;
+  }
+
+  auto timeout_ms = sctx().timeout_ms;
+  IF_Z3_ENABLED(auto z3ctx = sctx().z3 ? &*sctx().z3 : nullptr);
+  optional<extsolver::Result> extRes;
+  uint64_t extMs = 0;
+  atomic<bool> inProcessDone(false), extUnsatFirst(false);
+  auto startTime = chrono::steady_clock::now();
+
+  thread extThread([&]() {
+    extRes = ext->wait(timeout_ms);
+    extMs = getMsSince(startTime);
+    if (extRes->answer != extsolver::Answer::UNSAT || inProcessDone)
+      return;
+    extUnsatFirst = true;
+#ifdef SOLVER_Z3
+    // Z3 ignores an interrupt that arrives before its check starts, so keep
+    // interrupting until the check returns.
+    while (z3ctx && !inProcessDone) {
+      z3ctx->interrupt();
+      this_thread::sleep_for(chrono::milliseconds(1));
+    }
+#endif
+  });
+
+  auto cr = checkInProcess(assumptions);
+  inProcessDone = true;
+  setResourceUnits(cr, counts);
+  if (!cr.isUnknown())
+    ext->kill();
+  extThread.join();
+
+  if (extRes->answer == extsolver::Answer::UNKNOWN)
+    return cr;
+  if (cr.isUnknown() || extUnsatFirst) {
+    cr.winner = SolverType::EXTERNAL;
+    cr.winnerMs = extMs;
+  }
+  cr.externalSat = extRes->answer == extsolver::Answer::SAT;
+  external_model = std::move(extRes->model);
+  return cr;
+}
+
+string Solver::getExternalScript(const vector<Expr> &assumptions) {
+  string script = "(set-option :produce-models true)\n";
+#ifdef SOLVER_Z3
+  if (z3) {
+    if (assumptions.empty())
+      return script + "(set-logic " + logic + ")\n" + z3->to_smt2() +
+          "(get-model)\n";
+    vector<Z3_ast> fmls;
+    auto assertions = z3->assertions();
+    for (unsigned i = 0; i < assertions.size(); ++i)
+      fmls.push_back(assertions[i]);
+    for (auto &a: assumptions)
+      fmls.push_back(a.getZ3Expr());
+    auto &ctx = z3->ctx();
+    Z3_ast last = fmls.back();
+    fmls.pop_back();
+    return script + "(set-logic " + logic + ")\n" +
+        Z3_benchmark_to_smtlib_string(ctx, "", "", "unknown", "",
+                                      fmls.size(), fmls.data(), last) +
+        "(get-model)\n";
+  }
+#endif
+#ifdef SOLVER_CVC5
+  if (sctx().cvc5) {
+    auto assertions = sctx().cvc5->getAssertions();
+    assertions.insert(assertions.end(), cvc5_assumptions.begin(),
+                      cvc5_assumptions.end());
+    return script + toCVC5Script(assertions) + "(get-model)\n";
+  }
+#endif
+  return script;
+}
+
+Solver::ResourceCounts Solver::getResourceCounts() const {
+  ResourceCounts counts;
+  IF_Z3_ENABLED(if (z3) counts.first = resourceunits::getZ3Count(*z3));
+  IF_CVC5_ENABLED(if (sctx().cvc5)
+      counts.second = resourceunits::getCVC5Count(*sctx().cvc5));
+  return counts;
+}
+
+void Solver::setResourceUnits(CheckResult &cr, const ResourceCounts &before)
+    const {
+  auto after = getResourceCounts();
+  if (before.first && after.first)
+    cr.z3ResourceUnits = *after.first - *before.first;
+  if (before.second && after.second)
+    cr.cvc5ResourceUnits = *after.second - *before.second;
+}
+
+#ifdef SOLVER_Z3
+static z3::check_result checkZ3(z3::solver &solver,
+                                const vector<Expr> &assumptions) {
+  if (assumptions.empty())
+    return solver.check();
+  auto vec = toZ3ExprVector(assumptions);
+  return solver.check(vec);
+}
+#endif // SOLVER_Z3
+
+#ifdef SOLVER_CVC5
+static cvc5::Result checkCVC5(cvc5::Solver &solver,
+                              const vector<cvc5::Term> &assumptions) {
+  if (assumptions.empty())
+    return solver.checkSat();
+  return solver.checkSatAssuming(assumptions);
+}
+#endif // SOLVER_CVC5
+
+CheckResult Solver::checkInProcess(const vector<Expr> &assumptions) {
+#if defined(SOLVER_Z3) && defined(SOLVER_CVC5)
+  if (z3 && sctx().cvc5)
+    return checkPortfolio(assumptions);
+#endif
+
   CheckResult cr;
-  SET_Z3(cr, fupdate(z3, [](auto &solver) { return solver.check(); }));
-  SET_CVC5(cr, fupdate(sctx.cvc5,
-      [](auto &solver) { return solver.checkSat(); }));
+  auto startTime = chrono::steady_clock::now();
+  SET_Z3(cr, fupdate(z3, [&assumptions](auto &solver) {
+    return checkZ3(solver, assumptions);
+  }));
+  SET_CVC5(cr, fupdate(sctx().cvc5, [this](auto &solver) {
+    return checkCVC5(solver, cvc5_assumptions);
+  }));
+  if (!cr.isUnknown()) {
+    cr.winner = SolverType::CVC5;
+    IF_Z3_ENABLED(if (z3) cr.winner = SolverType::Z3);
+    cr.winnerMs = getMsSince(startTime);
+  }
+  return cr;
+}
+
+#if defined(SOLVER_Z3) && defined(SOLVER_CVC5)
+// The first time slice of cvc5 in the portfolio mode
+static const uint64_t PORTFOLIO_FIRST_SLICE_MS = 100;
+
+CheckResult Solver::checkPortfolio(const vector<Expr> &assumptions) {
+  // Z3 runs on a helper thread, and cvc5 runs on this thread because the cvc5
+  // solver is shared by every expression of this thread's context.
+  // Z3 is interrupted when cvc5 answers first. cvc5 cannot be interrupted
+  // from another thread, so it runs in time slices, each as long as the
+  // check has taken so far. When Z3 answers first, cvc5 stops at the end of
+  // its slice, which is at most about twice Z3's time. A query that only
+  // cvc5 answers takes up to about three times as long because each slice
+  // starts the search again.
+  mutex winnerMutex;
+  optional<SolverType> winner;
+  uint64_t winnerMs = 0;
+  auto startTime = chrono::steady_clock::now();
+  auto setWinner = [&](SolverType s) {
+    lock_guard<mutex> lock(winnerMutex);
+    if (!winner) {
+      winner = s;
+      winnerMs = getMsSince(startTime);
+    }
+  };
+  auto hasWinner = [&]() {
+    lock_guard<mutex> lock(winnerMutex);
+    return winner.has_value();
+  };
+
+  z3::check_result z3res = z3::unknown;
+  atomic<bool> z3Done(false);
+  thread z3Thread([&]() {
+    z3res = checkZ3(*z3, assumptions);
+    if (z3res != z3::unknown)
+      setWinner(SolverType::Z3);
+    z3Done = true;
+  });
+
+  // 0 means no limit
+  uint64_t timeout_ms = sctx().use_rlimit && sctx().cvc5_units_per_ms > 0 ?
+      0 : sctx().timeout_ms;
+  auto &cvc5Solver = *sctx().cvc5;
+  cvc5::Result cvc5res;
+  while (true) {
+    uint64_t elapsed = getMsSince(startTime);
+    uint64_t slice = max(elapsed, PORTFOLIO_FIRST_SLICE_MS);
+    bool isLast = false;
+    if (timeout_ms != 0 && elapsed + slice >= timeout_ms) {
+      slice = timeout_ms > elapsed ? timeout_ms - elapsed : 1;
+      isLast = true;
+    }
+    cvc5Solver.setOption("tlimit-per", to_string(slice));
+    cvc5res = checkCVC5(cvc5Solver, cvc5_assumptions);
+
+    // Stop if cvc5 answered or gave up before its slice ran out
+    if (!cvc5res.isUnknown() || isLast ||
+        getMsSince(startTime) < elapsed + slice || hasWinner())
+      break;
+  }
+  sctx().setCVC5Limits();
+
+  if (cvc5res.isSat() || cvc5res.isUnsat()) {
+    setWinner(SolverType::CVC5);
+    // Z3 ignores an interrupt that arrives before its check starts, so keep
+    // interrupting until the check returns.
+    while (!z3Done) {
+      sctx().z3->interrupt();
+      this_thread::sleep_for(chrono::milliseconds(1));
+    }
+  }
+  z3Thread.join();
+
+  CheckResult cr;
+  cr.setZ3(std::move(z3res));
+  cr.setCVC5(std::move(cvc5res));
+  cr.winner = winner;
+  if (winner)
+    cr.winnerMs = winnerMs;
   return cr;
 }
+#endif // SOLVER_Z3 && SOLVER_CVC5
 
 Model Solver::getModel() const {
   Model m;
+#ifdef SOLVER_Z3
+  if (z3_model) {
+    m.setZ3(*z3_model);
+    return m;
+  }
+#endif
   SET_Z3(m, fmap(z3, [](auto &solver) { return solver.get_model(); }));
+#ifdef SOLVER_CVC5
+  if (sctx().cvc5) {
+    auto &solver = *sctx().cvc5;
+    m.cvc5_assumptions = cvc5_assumptions;
+
+    auto roots = solver.getAssertions();
+    roots.insert(roots.end(), cvc5_assumptions.begin(),
+                 cvc5_assumptions.end());
+    auto consts = getCVC5FreeConsts(std::move(roots));
+    try {
+      // Read all values at once while cvc5 is still in its sat state
+      m.cvc5_values = solver.getValue(consts);
+      verbose("getModel") << "read the cvc5 values of " << consts.size()
+                          << " constants\n";
+      m.cvc5_consts = std::move(consts);
+    } catch (const cvc5::CVC5ApiException &) {
+      // cvc5 did not answer sat (e.g., Z3 answered first in the portfolio
+      // mode). eval() solves the query again.
+    }
+  }
+#endif // SOLVER_CVC5
   return m;
 }
 
+bool Solver::canCheckConcurrently() {
+  if (extsolver::isEnabled())
+    return false;
+  bool res = false;
+  IF_Z3_ENABLED(res = sctx().z3.has_value());
+  IF_CVC5_ENABLED(res &= !sctx().cvc5);
+  return res;
+}
 
-void useZ3() { IF_Z3_ENABLED(sctx.useZ3()); }
-void useCVC5() { IF_CVC5_ENABLED(sctx.useCVC5()); }
-uint64_t getTimeout() { return sctx.timeout_ms; }
-void setTimeout(const uint64_t ms) { sctx.timeout_ms = ms; }
+vector<CheckResult> Solver::checkConcurrently(
+    const vector<Solver *> &solvers, unsigned numThreads) {
+  size_t n = solvers.size();
+  vector<CheckResult> results(n, CheckResult());
+  auto isDone = [](const CheckResult &cr) { return !cr.hasUnsat(); };
+
+#ifdef SOLVER_Z3
+  if (canCheckConcurrently() && numThreads > 1 && n > 1) {
+    // A Z3 context must not be used by two threads at once, so the queries
+    // are copied to new contexts on this thread before the workers start.
+    vector<unique_ptr<z3::context>> ctxs;
+    vector<z3::solver> copies;
+    copies.reserve(n);
+    for (auto s: solvers) {
+      ctxs.push_back(make_unique<z3::context>());
+      sctx().setZ3Limits(*ctxs.back());
+      copies.emplace_back(*ctxs.back(), *s->z3, z3::solver::translate());
+    }
+
+    enum { PENDING, RUNNING, FINISHED };
+    vector<atomic<int>> states(n);
+    for (auto &st: states)
+      st = PENDING;
+    vector<z3::check_result> z3res(n, z3::unknown);
+    vector<uint64_t> z3ms(n, 0);
+    atomic<size_t> nextQuery(0), firstDone(n);
+
+    auto worker = [&]() {
+      size_t i;
+      while ((i = nextQuery++) < n) {
+        // Publish RUNNING before reading firstDone; a thread that lowers
+        // firstDone either sees RUNNING and interrupts us or is seen here.
+        states[i] = RUNNING;
+        if (i > firstDone) {
+          states[i] = FINISHED;
+          continue;
+        }
+        auto startTime = chrono::steady_clock::now();
+        z3res[i] = copies[i].check();
+        z3ms[i] = getMsSince(startTime);
+        states[i] = FINISHED;
+
+        if (z3res[i] == z3::unknown || z3res[i] == z3::sat) {
+          size_t prev = firstDone;
+          while (i < prev && !firstDone.compare_exchange_weak(prev, i));
+          // Z3 ignores an interrupt that arrives before its check starts, so
+          // keep interrupting until the check returns.
+          for (size_t j = i + 1; j < n; ++j) {
+            while (states[j] == RUNNING) {
+              ctxs[j]->interrupt();
+              this_thread::sleep_for(chrono::milliseconds(1));
+            }
+          }
+        }
+      }
+    };
+
+    vector<thread> threads;
+    for (unsigned t = 0; t < min((size_t)numThreads, n); ++t)
+      threads.emplace_back(worker);
+    for (auto &t: threads)
+      t.join();
+
+    for (size_t i = 0; i < n; ++i) {
+      results[i].setZ3(std::move(z3res[i]));
+      // Each query has a context of its own
+      results[i].z3ResourceUnits = resourceunits::getZ3Count(copies[i]);
+      if (z3res[i] != z3::unknown) {
+        results[i].winner = SolverType::Z3;
+        results[i].winnerMs = z3ms[i];
+      }
+      if (z3res[i] == z3::sat) {
+        auto model = copies[i].get_model();
+        solvers[i]->z3_model.emplace(model, *sctx().z3, z3::model::translate());
+      }
+    }
+    return results;
+  }
+#endif // SOLVER_Z3
+
+  for (size_t i = 0; i < n; ++i) {
+    results[i] = solvers[i]->check();
+    if (isDone(results[i]))
+      break;
+  }
+  return results;
+}
+
+
+void useZ3() { IF_Z3_ENABLED(sctx().useZ3()); }
+void useCVC5() { IF_CVC5_ENABLED(sctx().useCVC5()); }
+uint64_t getTimeout() { return sctx().timeout_ms; }
+
+double getSimplifyTimeMs() {
+  return chrono::duration<double, milli>(simplify_time).count();
+}
+void setTimeout(const uint64_t ms) {
+  sctx().setLimits(ms, sctx().use_rlimit);
+}
+
+atomic<uint64_t> Context::z3_units_per_ms(0), Context::cvc5_units_per_ms(0);
+
+bool usesResourceLimit() { return sctx().use_rlimit; }
+void setResourceLimit(bool enable, uint64_t z3UnitsPerMs,
+                      uint64_t cvc5UnitsPerMs) {
+  Context::z3_units_per_ms = z3UnitsPerMs;
+  Context::cvc5_units_per_ms = cvc5UnitsPerMs;
+  sctx().setLimits(sctx().timeout_ms, enable);
+}
+
+ContextConfig getContextConfig() {
+  ContextConfig cfg = {false, false, sctx().timeout_ms, sctx().use_rlimit};
+  IF_Z3_ENABLED(cfg.useZ3 = sctx().z3.has_value());
+  IF_CVC5_ENABLED(cfg.useCVC5 = sctx().cvc5.has_value());
+  return cfg;
+}
+
+shared_ptr<Context> makeContext(const ContextConfig &cfg) {
+  auto ctx = make_shared<Context>();
+  ctx->timeout_ms = cfg.timeout_ms;
+  ctx->use_rlimit = cfg.use_rlimit;
+  IF_Z3_ENABLED(if (cfg.useZ3) ctx->useZ3());
+  IF_CVC5_ENABLED(if (cfg.useCVC5) ctx->useCVC5());
+  return ctx;
+}
+
+ContextScope::ContextScope(Context &ctx): prev(currentContext) {
+  currentContext = &ctx;
+}
+
+ContextScope::~ContextScope() {
+  currentContext = prev;
+}
+
+void clearNamedTerms() {
+  IF_CVC5_ENABLED(sctx().clearCachedTerms());
+}
+
+void setFnDefinitions(vector<FnDefinition> &&defs) {
+  sctx().fn_definitions = std::move(defs);
+}
+
+void clearFnDefinitions() {
+  sctx().fn_definitions.clear();
+}
 
 
 
@@ -1784,17 +2663,18 @@ bool Matcher::matchBinaryOp(const Expr &expr, Z3_decl_kind z3Kind,
     function<bool(const Expr&)> rhsMatcher) const {
   if (expr.hasZ3Expr()) {
     auto e = expr.getZ3Expr();
-    if (!e.is_app())
+    // Simplified bvadd and bvmul can have more than two operands
+    if (!e.is_app() || e.num_args() != 2)
       return false;
 
     Z3_app a = e;
-    Z3_func_decl decl = Z3_get_app_decl(*sctx.z3, a);
-    if (Z3_get_decl_kind(*sctx.z3, decl) != z3Kind)
+    Z3_func_decl decl = Z3_get_app_decl(*sctx().z3, a);
+    if (Z3_get_decl_kind(*sctx().z3, decl) != z3Kind)
       return false;
 
     Expr lhs = newExpr(), rhs = newExpr();
-    setZ3(lhs, z3::expr(*sctx.z3, Z3_get_app_arg(*sctx.z3, a, 0)));
-    setZ3(rhs, z3::expr(*sctx.z3, Z3_get_app_arg(*sctx.z3, a, 1)));
+    setZ3(lhs, z3::expr(*sctx().z3, Z3_get_app_arg(*sctx().z3, a, 0)));
+    setZ3(rhs, z3::expr(*sctx().z3, Z3_get_app_arg(*sctx().z3, a, 1)));
     return lhsMatcher(lhs) && rhsMatcher(rhs);
   } else {
     return false;
@@ -1839,12 +2719,12 @@ bool ConstSplatArray::operator()(const Expr &expr) const {
       return false;
 
     Z3_app a = e;
-    Z3_func_decl decl = Z3_get_app_decl(*sctx.z3, a);
-    if (Z3_get_decl_kind(*sctx.z3, decl) != Z3_OP_CONST_ARRAY)
+    Z3_func_decl decl = Z3_get_app_decl(*sctx().z3, a);
+    if (Z3_get_decl_kind(*sctx().z3, decl) != Z3_OP_CONST_ARRAY)
       return false;
 
     Expr newe = newExpr();
-    setZ3(newe, z3::expr(*sctx.z3, Z3_get_app_arg(*sctx.z3, a, 0)));
+    setZ3(newe, z3::expr(*sctx().z3, Z3_get_app_arg(*sctx().z3, a, 0)));
     return subMatcher(newe);
   }
 #endif // SOLVER_Z3
@@ -1872,10 +2752,10 @@ bool Lambda::operator()(const Expr &expr) const {
     if (!e.is_lambda())
       return false;
 
-    Z3_ast body = Z3_get_quantifier_body(*sctx.z3, (Z3_ast)e);
+    Z3_ast body = Z3_get_quantifier_body(*sctx().z3, (Z3_ast)e);
 
     Expr newe = newExpr();
-    setZ3(newe, z3::expr(*sctx.z3, body));
+    setZ3(newe, z3::expr(*sctx().z3, body));
 
     // Z3 matches body only (because Z3 supports de bruijn indexing)
     return bodyMatcher(newe);
@@ -1910,14 +2790,14 @@ bool Store::operator()(const Expr &expr) const {
       return false;
 
     Z3_app a = e;
-    Z3_func_decl decl = Z3_get_app_decl(*sctx.z3, a);
-    if (Z3_get_decl_kind(*sctx.z3, decl) != Z3_OP_STORE)
+    Z3_func_decl decl = Z3_get_app_decl(*sctx().z3, a);
+    if (Z3_get_decl_kind(*sctx().z3, decl) != Z3_OP_STORE)
       return false;
 
     Expr arr = newExpr(), idx = newExpr(), val = newExpr();
-    setZ3(arr, z3::expr(*sctx.z3, Z3_get_app_arg(*sctx.z3, a, 0)));
-    setZ3(idx, z3::expr(*sctx.z3, Z3_get_app_arg(*sctx.z3, a, 1)));
-    setZ3(val, z3::expr(*sctx.z3, Z3_get_app_arg(*sctx.z3, a, 2)));
+    setZ3(arr, z3::expr(*sctx().z3, Z3_get_app_arg(*sctx().z3, a, 0)));
+    setZ3(idx, z3::expr(*sctx().z3, Z3_get_app_arg(*sctx().z3, a, 1)));
+    setZ3(val, z3::expr(*sctx().z3, Z3_get_app_arg(*sctx().z3, a, 2)));
 
     return arrMatcher(arr) && idxMatcher(idx) && valMatcher(val);
   }
@@ -1942,6 +2822,58 @@ bool Store::operator()(const Expr &expr) const {
   return false;
 }
 
+bool Select::operator()(const Expr &expr) const {
+#ifdef SOLVER_Z3
+  // Selects on multi-dimensional arrays have more than one index and do not
+  // match
+  if (expr.hasZ3Expr())
+    return matchBinaryOp(expr, Z3_OP_SELECT, arrMatcher, idxMatcher);
+#endif // SOLVER_Z3
+#ifdef SOLVER_CVC5
+  if (expr.hasCVC5Term())
+    return matchBinaryOp(expr, cvc5::Kind::SELECT, arrMatcher, idxMatcher);
+#endif // SOLVER_CVC5
+
+  return false;
+}
+
+bool Ite::operator()(const Expr &expr) const {
+#ifdef SOLVER_Z3
+  if (expr.hasZ3Expr()) {
+    auto e = expr.getZ3Expr();
+    if (!e.is_app())
+      return false;
+
+    Z3_app a = e;
+    Z3_func_decl decl = Z3_get_app_decl(*sctx().z3, a);
+    if (Z3_get_decl_kind(*sctx().z3, decl) != Z3_OP_ITE)
+      return false;
+
+    Expr cond = newExpr(), then = newExpr(), els = newExpr();
+    setZ3(cond, z3::expr(*sctx().z3, Z3_get_app_arg(*sctx().z3, a, 0)));
+    setZ3(then, z3::expr(*sctx().z3, Z3_get_app_arg(*sctx().z3, a, 1)));
+    setZ3(els, z3::expr(*sctx().z3, Z3_get_app_arg(*sctx().z3, a, 2)));
+
+    return condMatcher(cond) && thenMatcher(then) && elsMatcher(els);
+  }
+#endif // SOLVER_Z3
+#ifdef SOLVER_CVC5
+  if (expr.hasCVC5Term()) {
+    auto term = expr.getCVC5Term();
+    if (term.getKind() != cvc5::Kind::ITE || term.getNumChildren() != 3)
+      return false;
+
+    Expr cond = newExpr(), then = newExpr(), els = newExpr();
+    setCVC5(cond, std::move(term[0]));
+    setCVC5(then, std::move(term[1]));
+    setCVC5(els, std::move(term[2]));
+
+    return condMatcher(cond) && thenMatcher(then) && elsMatcher(els);
+  }
+#endif // SOLVER_CVC5
+  return false;
+}
+
 bool Concat::operator()(const Expr &expr) const {
 #ifdef SOLVER_Z3
   if (expr.hasZ3Expr())
@@ -1984,6 +2916,20 @@ bool UDiv::operator()(const Expr &expr) const {
   return false;
 }
 
+bool Add::operator()(const Expr &expr) const {
+#ifdef SOLVER_Z3
+  if (expr.hasZ3Expr())
+    return matchBinaryOp(expr, Z3_OP_BADD, lhsMatcher, rhsMatcher);
+#endif // SOLVER_Z3
+#ifdef SOLVER_CVC5
+  if (expr.hasCVC5Term())
+    return matchBinaryOp(expr, cvc5::Kind::BITVECTOR_ADD, lhsMatcher,
+                         rhsMatcher);
+#endif // SOLVER_CVC5
+
+  return false;
+}
+
 bool Mul::operator()(const Expr &expr) const {
 #ifdef SOLVER_Z3
   if (expr.hasZ3Expr())
@@ -2006,12 +2952,12 @@ bool ZeroExt::operator()(const Expr &expr) const {
       return false;
 
     Z3_app a = e;
-    Z3_func_decl decl = Z3_get_app_decl(*sctx.z3, a);
-    if (Z3_get_decl_kind(*sctx.z3, decl) != Z3_OP_ZERO_EXT)
+    Z3_func_decl decl = Z3_get_app_decl(*sctx().z3, a);
+    if (Z3_get_decl_kind(*sctx().z3, decl) != Z3_OP_ZERO_EXT)
       return false;
 
     Expr subexpr = newExpr();
-    setZ3(subexpr, z3::expr(*sctx.z3, Z3_get_app_arg(*sctx.z3, a, 0)));
+    setZ3(subexpr, z3::expr(*sctx().z3, Z3_get_app_arg(*sctx().z3, a, 0)));
     return matcher(subexpr);
   }
 #endif // SOLVER_Z3
@@ -2050,14 +2996,14 @@ bool Equals::operator()(const Expr &expr) const {
 namespace {
 #ifdef SOLVER_Z3
 z3::expr_vector toZ3ExprVector(const vector<smt::Expr> &vec) {
-  z3::expr_vector ev(*smt::sctx.z3);
+  z3::expr_vector ev(*smt::sctx().z3);
   for (auto &e: vec)
     ev.push_back(e.getZ3Expr());
   return ev;
 }
 
 z3::sort_vector toZ3SortVector(const vector<smt::Sort> &vec) {
-  z3::sort_vector ev(*smt::sctx.z3);
+  z3::sort_vector ev(*smt::sctx().z3);
   for (auto &e: vec)
     ev.push_back(e.getZ3Sort());
   return ev;
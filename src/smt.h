@@ -3,6 +3,7 @@
 #include "llvm/Support/raw_ostream.h"
 #include <vector>
 #include <optional>
+#include <memory>
 
 #ifdef SOLVER_Z3
   #include "z3++.h"
@@ -27,11 +28,17 @@
 namespace smt {
 class Expr;
 class FnDecl;
+class Context;
 class Model;
 class Sort;
 
 enum SolverType {
-  Z3, CVC5
+  Z3, CVC5,
+  // Run Z3 and cvc5 concurrently and take the first definitive answer
+  PORTFOLIO,
+  // A solver process that is run next to the others (see extsolver.h).
+  // It is only reported as the winner of a check.
+  EXTERNAL
 };
 
 namespace matchers {
@@ -90,6 +97,9 @@ public:
   cvc5::Term getCVC5Term() const;
   bool hasCVC5Term() const;
   bool isConstantCVC5Term() const;
+  // An SMT-LIB2 script that declares the constants of this formula, asserts
+  // it and checks its satisfiability
+  std::string toCVC5Script() const;
 #endif // SOLVER_CVC5
 
   // Lock arithmetic operations that create new expressions for debugging.
@@ -98,6 +108,8 @@ public:
 
   Expr simplify() const;
   Sort sort() const;
+  // The number of distinct subterms
+  uint64_t dagSize() const;
   unsigned bitwidth() const;
   std::vector<Expr> toNDIndices(const std::vector<Expr> &dims) const;
 
@@ -196,6 +208,9 @@ public:
 
   Expr substitute(const std::vector<Expr> &vars,
                   const std::vector<Expr> &values) const;
+  // Replace the applications of the functions given to setFnDefinitions
+  // with their bodies.
+  Expr expandDefinitions() const;
 
   // Returns true if this and e2's expr are equal.
   // Note that
@@ -206,6 +221,8 @@ public:
   // If is_or is true, this returns true if at least one solver's expr is equal.
   // Otherwise, it returns true if all of the solvers' exprs are equivalent.
   bool isIdentical(const Expr &e2, bool is_or = true) const;
+  // Identical exprs have the same hash (for isIdentical(e2, false))
+  size_t hash() const;
 
   // Make a fresh, unbound variable.
   static Expr mkFreshVar(const Sort &s, const std::string &prefix);
@@ -287,9 +304,28 @@ public:
   friend Expr;
 };
 
+// The definition of a function that was declared without a body.
+// params stand for the arguments of an application in body.
+struct FnDefinition {
+  FnDecl fn;
+  std::vector<Expr> params;
+  Expr body;
+};
+
 class CheckResult : private Object<T_Z3(z3::check_result),
                                     T_CVC5(cvc5::Result)> {
 private:
+  // The solver that gave the first definitive answer, and how long it took
+  // from the start of the check
+  std::optional<SolverType> winner;
+  std::optional<uint64_t> winnerMs;
+  // Set if this result was read from a cache rather than solved
+  std::optional<bool> cachedSat;
+  // Set if the external solver answered sat or unsat
+  std::optional<bool> externalSat;
+  // The resource units that each in-process solver spent on the check
+  std::optional<uint64_t> z3ResourceUnits, cvc5ResourceUnits;
+
   CheckResult() {}
 
 public:
@@ -298,6 +334,16 @@ public:
   bool hasUnsat() const;
   // Has both SAT and UNSAT?
   bool isInconsistent() const;
+  // Which solver answered first? nullopt if no solver gave sat or unsat.
+  std::optional<SolverType> getWinner() const { return winner; }
+  // The time that the winner took. The check itself may take longer because
+  // cvc5 only stops at the end of a time slice (see Solver::check()).
+  std::optional<uint64_t> getWinnerMs() const { return winnerMs; }
+  bool isCached() const { return cachedSat.has_value(); }
+  // nullopt if the solver did not run or does not report its resource usage
+  std::optional<uint64_t> getResourceUnits(SolverType s) const;
+
+  static CheckResult fromCache(bool isSat);
 
   friend Solver;
 };
@@ -312,7 +358,20 @@ private:
   std::optional<z3::model> z3;
   void setZ3(std::optional<z3::model> &&m) { z3 = std::move(m); }
 #endif
-  // No need for CVC5
+#ifdef SOLVER_CVC5
+  // The values of the free constants of the query, read from cvc5 once after
+  // it answered sat. Expressions are evaluated by substituting them.
+  std::vector<cvc5::Term> cvc5_consts;
+  std::optional<std::vector<cvc5::Term>> cvc5_values;
+  // cvc5 has to solve the query again to evaluate expressions that the
+  // values do not cover
+  std::vector<cvc5::Term> cvc5_assumptions;
+
+  // The values of es. The solver is run again at most once, for all the
+  // expressions that the values of the constants do not cover.
+  std::vector<cvc5::Term> evalCVC5(
+      cvc5::Solver &solver, const std::vector<cvc5::Term> &es) const;
+#endif
 
 public:
   Expr eval(const Expr &e, bool modelCompletion = false) const;
@@ -330,28 +389,139 @@ public:
 #endif
   // No need for CVC5
 
-  Solver(const char *logic);
+  // step names the kind of the queries (e.g., "ub"), which selects the Z3
+  // tactic pipeline (see addZ3Tactic)
+  Solver(const char *logic, const std::string &step = "");
   Solver(const Solver &) = delete;
   ~Solver();
 
   void add(const Expr &e);
   void reset();
 
-  // If two solvers are available, serially run both of them. The returning
-  // CheckResult object will store both results.
+  // If two solvers are available, run both of them concurrently. The returning
+  // CheckResult object will store both results. Z3 is interrupted when cvc5
+  // answers first. cvc5 has no way to be interrupted from another thread, so
+  // it runs in time slices that grow with the time of the check, and stops at
+  // the end of its slice when Z3 answers first.
+  // If an external solver is set (extsolver::setCommand), it runs as well.
+  // Its unsat answer interrupts Z3, but its sat answer does not so that a
+  // model can still be found; see getExternalModel().
   CheckResult check();
+  // Check under the assumptions, which are boolean constants. Unlike adding
+  // them, this keeps what the solver learned for later checks.
+  // The solvers are run as check() runs them. The external solver gets the
+  // assumptions as assertions.
+  CheckResult check(const std::vector<Expr> &assumptions);
 
   // NOTE: Models work only for Z3
   Model getModel() const;
+  // The model that the external solver printed, in its own text format.
+  // This is the only model if the external solver was the winner.
+  const std::string &getExternalModel() const { return external_model; }
+
+  // Check the solvers concurrently on at most numThreads threads. Once a
+  // solver is not unsat, the solvers after it are interrupted and their
+  // results must not be used.
+  // Every query is copied to a Z3 context of its own, which is possible only
+  // if canCheckConcurrently(); otherwise they are checked one by one with
+  // check().
+  static std::vector<CheckResult> checkConcurrently(
+      const std::vector<Solver *> &solvers, unsigned numThreads);
+  // Is Z3 the sole solver in use? cvc5 solvers share one assertion stack,
+  // so they cannot be checked concurrently. The queries are not copied for
+  // the external solver either, so it must not be set.
+  static bool canCheckConcurrently();
+
+private:
+  std::string logic;
+  std::string external_model;
+#ifdef SOLVER_Z3
+  // The model of a query that checkConcurrently() solved in another context
+  std::optional<z3::model> z3_model;
+#endif
+#ifdef SOLVER_CVC5
+  std::vector<cvc5::Term> cvc5_assumptions;
+#endif
+
+  CheckResult checkInProcess(const std::vector<Expr> &assumptions);
+  // The resource units that the solvers have spent so far. The counters only
+  // grow, so the units of a check are the difference.
+  using ResourceCounts =
+      std::pair<std::optional<uint64_t>, std::optional<uint64_t>>;
+  ResourceCounts getResourceCounts() const;
+  void setResourceUnits(CheckResult &cr, const ResourceCounts &before) const;
+  // The query as an SMT-LIB2 script for the external solver
+  std::string getExternalScript(const std::vector<Expr> &assumptions);
+
+#if defined(SOLVER_Z3) && defined(SOLVER_CVC5)
+  CheckResult checkPortfolio(const std::vector<Expr> &assumptions);
+#endif
 };
 
 void useZ3();
 void useCVC5();
 uint64_t getTimeout();
 void setTimeout(const uint64_t ms);
+// Limit each query by the resource units that the solver spends in the
+// timeout instead of by wall-clock time, so that the result does not depend
+// on the load of the host. The external solver is still limited by time.
+bool usesResourceLimit();
+// The rates are the resource units that each solver spends per millisecond
+// (see mlir-tv-replay). A solver whose rate is 0 is limited by time.
+void setResourceLimit(bool enable, uint64_t z3UnitsPerMs,
+                      uint64_t cvc5UnitsPerMs);
+// Let Z3 solve the queries of logic and step with a tactic pipeline, e.g.,
+// "simplify+bvarray2uf+ackermannize_bv+bit-blast+sat", instead of its default
+// solver for the logic. "*" matches any logic or step, and the pipeline that
+// was added last wins. Z3's default tactic takes over the queries that the
+// pipeline fails on. This is set before validation starts and shared by
+// every thread. Returns false and sets err if a tactic does not exist.
+bool addZ3Tactic(const std::string &logic, const std::string &step,
+                 const std::string &pipeline, std::string &err);
+void clearZ3Tactics();
+// Is there a pipeline for a step other than "*"?
+bool hasZ3StepTactics();
+// The time that Expr::simplify has taken in the calling thread
+double getSimplifyTimeMs();
+
+// A context owns the solvers, the fresh name counter and the term caches.
+// An expression belongs to the context that was current when it was created,
+// and must be used only while that context is current in the same thread.
+// Every thread has a default context. A thread can instead work on a context
+// of its own that is destroyed with its last owner, so that independent
+// validations can run at the same time.
+struct ContextConfig {
+  bool useZ3;
+  bool useCVC5;
+  uint64_t timeout_ms;
+  bool use_rlimit;
+};
+// The configuration of the current context
+ContextConfig getContextConfig();
+std::shared_ptr<Context> makeContext(const ContextConfig &cfg);
+
+// Make ctx the current context of the calling thread until the scope ends.
+// Thread-local state that holds expressions of ctx (e.g., the abstraction of
+// aop) must be released before ctx is destroyed.
+class ContextScope {
+  Context *prev;
+
+public:
+  ContextScope(Context &ctx);
+  ContextScope(const ContextScope &) = delete;
+  ~ContextScope();
+};
+
+// Drop the named constants that the current context caches, so that a
+// context that is reused by many validations does not keep growing.
+void clearNamedTerms();
+
+// Set the definitions that Expr::expandDefinitions and Model::eval use.
+// They belong to the context of the calling thread.
+void setFnDefinitions(std::vector<FnDefinition> &&defs);
+void clearFnDefinitions();
 
-// TODO: We will need to make the smt::Context context visible to users & carry
-// it as an object
+// Release the solvers of the current context
 void releaseResources();
 } // namespace smt
 
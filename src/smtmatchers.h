@@ -86,6 +86,31 @@ public:
   bool operator()(const Expr &e) const;
 };
 
+class Select: Matcher {
+  std::function<bool(const Expr &)> arrMatcher, idxMatcher;
+
+public:
+  template<class T1, class T2>
+  Select(T1 &&arr, T2 &&idx):
+      arrMatcher(std::move(arr)), idxMatcher(std::move(idx)) {}
+
+  bool match(const Expr &expr) const { return (*this)(expr); }
+  bool operator()(const Expr &e) const;
+};
+
+class Ite: Matcher {
+  std::function<bool(const Expr &)> condMatcher, thenMatcher, elsMatcher;
+
+public:
+  template<class T1, class T2, class T3>
+  Ite(T1 &&cond, T2 &&then, T3 &&els):
+      condMatcher(std::move(cond)), thenMatcher(std::move(then)),
+      elsMatcher(std::move(els)) {}
+
+  bool match(const Expr &expr) const { return (*this)(expr); }
+  bool operator()(const Expr &e) const;
+};
+
 class Concat: Matcher {
   std::function<bool(const Expr &)> lhsMatcher, rhsMatcher;
 
@@ -121,6 +146,18 @@ public:
   bool operator()(const Expr &e) const;
 };
 
+class Add: Matcher {
+  std::function<bool(const Expr &)> lhsMatcher, rhsMatcher;
+
+public:
+  template<class T1, class T2>
+  Add(T1 &&lhs, T2 &&rhs):
+      lhsMatcher(std::move(lhs)), rhsMatcher(std::move(rhs)) {}
+
+  bool match(const Expr &expr) const { return (*this)(expr); }
+  bool operator()(const Expr &e) const;
+};
+
 class Mul: Matcher {
   std::function<bool(const Expr &)> lhsMatcher, rhsMatcher;
 
@@ -72,6 +72,10 @@ public:
   bool hasQuantifier;
   bool hasConstArray;
   std::shared_ptr<Memory> m;
+  // The sizes of the dynamic dimensions of the arguments that this state
+  // created. The target reuses the arguments of the source, so only the
+  // source has them.
+  std::vector<smt::Expr> dynamicDims;
 
   State(std::unique_ptr<Memory> &&initMem);
 
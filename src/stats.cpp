@@ -0,0 +1,182 @@
+#include "stats.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <sys/resource.h>
+
+using namespace std;
+
+namespace {
+using Times = map<string, double>;
+
+struct Iteration {
+  vector<pair<string, string>> abstraction;
+  bool reusedEncoding;
+  Times times;
+  vector<stats::Query> queries;
+};
+
+struct Function {
+  string name;
+  string result;
+  Times times;
+  vector<Iteration> iterations;
+};
+
+atomic<bool> enabled(false);
+
+mutex recordsMutex;
+Times globalTimes;
+vector<Function> functions;
+
+thread_local optional<Function> current;
+
+void writeTimes(llvm::json::OStream &os, const Times &times) {
+  os.attributeObject("times_ms", [&]() {
+    for (auto &[phase, ms]: times)
+      os.attribute(phase, ms);
+  });
+}
+
+void writeQuery(llvm::json::OStream &os, const stats::Query &q) {
+  os.object([&]() {
+    os.attribute("name", q.name);
+    os.attribute("logic", q.logic);
+    os.attribute("term_size", (int64_t)q.termSize);
+    os.attribute("result", q.result);
+    os.attribute("cached", q.cached);
+    if (q.solveMs)
+      os.attribute("solve_ms", *q.solveMs);
+    if (!q.resourceUnits.empty()) {
+      os.attributeObject("resource_units", [&]() {
+        for (auto &[solver, units]: q.resourceUnits)
+          os.attribute(solver, (int64_t)units);
+      });
+    }
+  });
+}
+
+void writeFunction(llvm::json::OStream &os, const Function &fn) {
+  os.object([&]() {
+    os.attribute("name", fn.name);
+    os.attribute("result", fn.result);
+    writeTimes(os, fn.times);
+    os.attributeArray("iterations", [&]() {
+      for (auto &itr: fn.iterations) {
+        os.object([&]() {
+          os.attributeObject("abstraction", [&]() {
+            for (auto &[op, level]: itr.abstraction)
+              os.attribute(op, level);
+          });
+          os.attribute("reused_encoding", itr.reusedEncoding);
+          writeTimes(os, itr.times);
+          os.attributeArray("queries", [&]() {
+            for (auto &q: itr.queries)
+              writeQuery(os, q);
+          });
+        });
+      }
+    });
+  });
+}
+
+// In kilobytes
+int64_t getPeakRSS() {
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return -1;
+  return usage.ru_maxrss;
+}
+}
+
+namespace stats {
+
+void enable() {
+  enabled = true;
+}
+
+bool isEnabled() {
+  return enabled;
+}
+
+void addTime(const string &phase, double ms) {
+  if (!enabled)
+    return;
+  lock_guard<mutex> lock(recordsMutex);
+  globalTimes[phase] += ms;
+}
+
+void beginFunction(const string &name) {
+  if (!enabled)
+    return;
+  current.emplace();
+  current->name = name;
+}
+
+void addFunctionTime(const string &phase, double ms) {
+  if (!current)
+    return;
+  current->times[phase] += ms;
+}
+
+void beginIteration(vector<pair<string, string>> &&abs, bool reusedEncoding) {
+  if (!current)
+    return;
+  current->iterations.push_back({std::move(abs), reusedEncoding, {}, {}});
+}
+
+void addIterationTime(const string &phase, double ms) {
+  if (!current || current->iterations.empty())
+    return;
+  current->iterations.back().times[phase] += ms;
+}
+
+void addQuery(Query &&q) {
+  if (!current || current->iterations.empty())
+    return;
+  current->iterations.back().queries.push_back(std::move(q));
+}
+
+void endFunction(const string &result) {
+  if (!current)
+    return;
+  current->result = result;
+  lock_guard<mutex> lock(recordsMutex);
+  functions.push_back(std::move(*current));
+  current.reset();
+}
+
+bool write(const string &path) {
+  error_code ec;
+  llvm::raw_fd_ostream fout(path, ec, llvm::sys::fs::OF_Text);
+  if (ec)
+    return false;
+
+  lock_guard<mutex> lock(recordsMutex);
+  // Functions validated in parallel finish in any order
+  stable_sort(functions.begin(), functions.end(),
+      [](const Function &a, const Function &b) { return a.name < b.name; });
+
+  llvm::json::OStream os(fout, 2);
+  os.object([&]() {
+    os.attribute("peak_rss_kb", getPeakRSS());
+    writeTimes(os, globalTimes);
+    os.attributeArray("functions", [&]() {
+      for (auto &fn: functions)
+        writeFunction(os, fn);
+    });
+  });
+  fout << "\n";
+  fout.close();
+  if (fout.has_error()) {
+    fout.clear_error();
+    return false;
+  }
+  return true;
+}
+
+} // namespace stats
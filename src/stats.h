@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Instrumentation for --stats-json. Nothing is recorded unless enable() is
+// called. A function is recorded by the thread that validates it, so
+// functions that are validated in parallel do not share records.
+namespace stats {
+
+struct Query {
+  std::string name;
+  std::string logic;
+  // The number of distinct subterms of the query
+  uint64_t termSize;
+  // sat, unsat, unknown or inconsistent
+  std::string result;
+  bool cached;
+  // Unset if the query was checked together with others (--parallel-checks)
+  std::optional<double> solveMs;
+  // The resource units that each solver spent, e.g., {"z3", 1234}
+  std::vector<std::pair<std::string, uint64_t>> resourceUnits;
+};
+
+class Timer {
+  std::chrono::steady_clock::time_point start;
+
+public:
+  Timer(): start(std::chrono::steady_clock::now()) {}
+  double getMs() const {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+};
+
+void enable();
+bool isEnabled();
+
+// Add the time of a phase that does not belong to a function (e.g., parse).
+// The times of a phase are summed.
+void addTime(const std::string &phase, double ms);
+
+void beginFunction(const std::string &name);
+void addFunctionTime(const std::string &phase, double ms);
+// abstraction is a list of (op, level) pairs.
+void beginIteration(std::vector<std::pair<std::string, std::string>> &&abs,
+                    bool reusedEncoding);
+void addIterationTime(const std::string &phase, double ms);
+// Add a query to the current iteration.
+void addQuery(Query &&q);
+void endFunction(const std::string &result);
+
+// Write the records and the peak memory usage of the process as JSON.
+// Returns false if the file cannot be written.
+bool write(const std::string &path);
+
+} // namespace stats
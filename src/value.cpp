@@ -13,7 +13,7 @@ using namespace std;
 
 namespace {
 string freshName(string &&prefix) {
-  static int count = 0;
+  static thread_local int count = 0;
   return prefix + "#" + to_string(count ++);
 }
 }
@@ -56,7 +56,8 @@ optional<Expr> getIdentity(mlir::Type eltType) {
   return {};
 }
 
-static vector<pair<mlir::ElementsAttr, Tensor>> abstractlyEncodedAttrs;
+static thread_local vector<pair<mlir::ElementsAttr, Tensor>>
+    abstractlyEncodedAttrs;
 
 void resetAbstractlyEncodedAttrs() {
   abstractlyEncodedAttrs.clear();
@@ -108,7 +109,7 @@ Index Index::var(string &&name, VarType varty) {
   Index i(0);
   switch(varty) {
   case VarType::BOUND:
-    static unsigned varCount = 0;
+    static thread_local unsigned varCount = 0;
     i = {Expr::mkVar(Index::sort(), std::move(name) + "#" + to_string(varCount++),
             true)};
     break;
@@ -1393,7 +1394,7 @@ Tensor Tensor::fromElemsAttr(mlir::RankedTensorType tensorty,
           }
         }
 
-        static int count = 0;
+        static thread_local int count = 0;
         auto newt = Tensor::var(elemType, "unknown_const#" + to_string(count++),
             dimExprs);
         abstractlyEncodedAttrs.emplace_back(attr, newt);
@@ -1447,7 +1448,7 @@ Tensor Tensor::fromElemsAttr(mlir::RankedTensorType tensorty,
         }
       }
 
-      static int count = 0;
+      static thread_local int count = 0;
       Tensor newt = Tensor::var(elemType, "unknown_const#" + to_string(count++),
           dims);
       abstractlyEncodedAttrs.emplace_back(attr, newt);
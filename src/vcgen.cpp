@@ -1,22 +1,32 @@
 #include "abstractops.h"
+#include "absprofile.h"
 #include "debug.h"
 #include "encode.h"
+#include "extsolver.h"
+#include "function.h"
 #include "memory.h"
 #include "opts.h"
 #include "print.h"
+#include "querycache.h"
 #include "smt.h"
 #include "state.h"
+#include "stats.h"
 #include "utils.h"
 #include "value.h"
 #include "vcgen.h"
 #include "analysis.h"
+#include "mlir/IR/OperationSupport.h"
+#include "llvm/ADT/ScopeExit.h"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <fstream>
 #include <functional>
 #include <map>
 #include <optional>
 #include <sstream>
+#include <thread>
 #include <variant>
 #include <vector>
 #include <queue>
@@ -46,6 +56,8 @@ public:
   bool isFpAddAssociative;
   bool unrollIntSum; // sum(arr) := arr[0] + ... + arr[arr.len-1]
   bool useMultisetForFpSum;
+  // src and tgt are identical up to the names of SSA values
+  bool isSyntacticallyIdentical;
 };
 
 
@@ -55,6 +67,26 @@ llvm::cl::opt<bool> arg_fp_add_associative("associative",
   llvm::cl::init(false),
   llvm::cl::cat(MlirTvCategory));
 
+llvm::cl::opt<bool> arg_lazy_associative("lazy-associative",
+  llvm::cl::desc("Add the associativity constraints of --associative to a"
+                 " query only when the counterexample that the solver found"
+                 " violates them"),
+  llvm::cl::init(false),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<bool> arg_refine_per_op("refine-per-op",
+  llvm::cl::desc("When a counterexample is found under an abstraction, refine"
+                 " the abstraction of only the dot and sum ops that the"
+                 " counterexample relies on"),
+  llvm::cl::init(false),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<bool> arg_no_lazy_encoding("no-lazy-encoding",
+  llvm::cl::desc("Encode the dot and sum ops eagerly, and encode the functions"
+                 " again at each abstraction refinement step"),
+  llvm::cl::init(false), llvm::cl::Hidden,
+  llvm::cl::cat(MlirTvCategory));
+
 llvm::cl::opt<bool> arg_unroll_int_sum("unroll-int-sum",
   llvm::cl::desc("Fully unroll summation of integer arrays whose sizes are"
                  " known to be constant"),
@@ -137,6 +169,66 @@ llvm::cl::opt<bool> no_arith_properties("no-arith-properties",
       "(check only shape transformation)"),
   llvm::cl::init(false),
   llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<bool> arg_parallel_checks("parallel-checks",
+  llvm::cl::desc("Run the UB, return value and memory refinement checks of a"
+                 " function concurrently (Z3 only)"),
+  llvm::cl::init(false),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<bool> arg_split_memory_checks("split-memory-checks",
+  llvm::cl::desc("Check the memory refinement of each global block with a"
+                 " query of its own. The queries are solved concurrently"
+                 " with Z3, and the first mismatched block is reported"),
+  llvm::cl::init(false),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<unsigned> arg_split_dims("split-dims",
+  llvm::cl::desc("Split each refinement query into cubes over the dynamic"
+                 " dimensions of the arguments: a dimension is either one of"
+                 " the sizes 0..N-1 or at least N. The cubes are solved"
+                 " concurrently with Z3 (default=0, no splitting)"),
+  llvm::cl::init(0), llvm::cl::value_desc("N"),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<bool> arg_incremental_checks("incremental-checks",
+  llvm::cl::desc("Check the refinement obligations of a function with one"
+                 " solver, under assumptions"),
+  llvm::cl::init(false),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<string> arg_query_cache("query-cache",
+  llvm::cl::desc("Cache the sat and unsat answers of SMT queries in this"
+                 " directory. A timeout is not cached"),
+  llvm::cl::value_desc("dir"),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<unsigned> query_cache_max_entries("query-cache-max-entries",
+  llvm::cl::desc("Number of results kept in the query cache"
+                 " (default=100000)"),
+  llvm::cl::init(100000), llvm::cl::value_desc("number"),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<string> arg_abstraction_profile("abstraction-profile",
+  llvm::cl::desc("Record the abstractions that validated functions in this"
+                 " file, and start the validation of a function of the same"
+                 " shape at the recorded abstraction (not used with"
+                 " --refine-per-op)"),
+  llvm::cl::value_desc("file"),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<bool> arg_no_syntactic_check("no-syntactic-check",
+  llvm::cl::desc("Validate syntactically identical src and tgt functions with"
+                 " the SMT solver as well. By default, such a pair is reported"
+                 " as correct after checking only whether src is always"
+                 " undefined"),
+  llvm::cl::init(false),
+  llvm::cl::cat(MlirTvCategory));
+
+llvm::cl::opt<unsigned> num_threads("j",
+  llvm::cl::desc("Number of functions to validate in parallel (default=1)"),
+  llvm::cl::init(1), llvm::cl::value_desc("N"),
+  llvm::cl::cat(MlirTvCategory));
 };
 
 llvm::cl::opt<string> arg_verify_fn_name("compare-fn-name",
@@ -165,6 +257,13 @@ static optional<string> checkFunctionSignatures(
   return {};
 }
 
+static void addDynamicDims(State &s, const vector<Expr> &dims) {
+  for (auto &dim: dims) {
+    if (!dim.isNumeral())
+      s.dynamicDims.push_back(dim);
+  }
+}
+
 static State createInputState(
     mlir::func::FuncOp fn, std::unique_ptr<Memory> &&initMem,
     ArgInfo &args, vector<Expr> &preconds) {
@@ -195,6 +294,7 @@ static State createInputState(
 
       // Create fresh variables for unknown dimension sizes
       auto dims = ShapedValue::getDims(ty);
+      addDynamicDims(s, dims);
       auto tensor = Tensor::var(ty.getElementType(),
           "arg" + to_string(arg.getArgNumber()),
           dims);
@@ -208,6 +308,7 @@ static State createInputState(
 
       // Create fresh variables for unknown dimension sizes
       auto dims = ShapedValue::getDims(ty);
+      addDynamicDims(s, dims);
       auto layout = MemRef::getLayout(ty, dims);
 
       // TODO : out of bounds pointer is allowed?
@@ -253,7 +354,7 @@ static State createInputState(
   return s;
 }
 
-static pair<CheckResult, int64_t> solve(
+static void addQuery(
     Solver &solver, const Expr &refinement_negated,
     const string &dumpSMTPath, const string &dump_string_to_suffix) {
   //solver.reset();
@@ -270,11 +371,106 @@ static pair<CheckResult, int64_t> solve(
 #if SOLVER_CVC5
     if (refinement_negated.hasCVC5Term()) {
       ofstream fout(dumpSMTPath + ".cvc5." + dump_string_to_suffix + ".smt2");
-      fout << refinement_negated.getCVC5Term();
+      fout << refinement_negated.toCVC5Script();
       fout.close();
     }
 #endif
   }
+}
+
+// Print the solver that answered first, the time it took, and the time of
+// the whole check if that is longer (e.g., cvc5 finished its time slice after
+// Z3 answered).
+static void printWinner(const CheckResult &result,
+    const string &dump_string_to_suffix, int64_t elapsedMillisec) {
+  if (auto winner = result.getWinner()) {
+    string name = *winner == SolverType::Z3 ? "Z3" :
+        *winner == SolverType::CVC5 ? "cvc5" : extsolver::getName();
+    int64_t winnerMs = result.getWinnerMs().value_or(elapsedMillisec);
+    auto &os = verbose("solve") << dump_string_to_suffix << ": answered by "
+        << name << " in " << winnerMs << "ms";
+    if (elapsedMillisec > winnerMs)
+      os << " (check took " << elapsedMillisec << "ms)";
+    os << "\n";
+  }
+}
+
+static vector<pair<string, uint64_t>> getResourceUnits(
+    const CheckResult &result) {
+  vector<pair<string, uint64_t>> units;
+  if (auto n = result.getResourceUnits(SolverType::Z3))
+    units.emplace_back("z3", *n);
+  if (auto n = result.getResourceUnits(SolverType::CVC5))
+    units.emplace_back("cvc5", *n);
+  return units;
+}
+
+static void printResourceUnits(const CheckResult &result,
+    const string &dump_string_to_suffix) {
+  auto units = getResourceUnits(result);
+  if (units.empty())
+    return;
+  auto &os = verbose("solve") << dump_string_to_suffix << ": used";
+  for (auto &[solver, n]: units)
+    os << " " << n << " " << solver;
+  os << " resource units\n";
+}
+
+static const char *toString(const CheckResult &result) {
+  if (result.isInconsistent())
+    return "inconsistent";
+  else if (result.hasSat())
+    return "sat";
+  else if (result.hasUnsat())
+    return "unsat";
+  return "unknown";
+}
+
+static void recordQuery(const string &dump_string_to_suffix, const char *logic,
+    const Expr &query, const CheckResult &result,
+    optional<double> solveMs) {
+  if (!stats::isEnabled())
+    return;
+  stats::addQuery({dump_string_to_suffix, logic, query.dagSize(),
+                   toString(result), result.isCached(), solveMs,
+                   getResourceUnits(result)});
+}
+
+static string getQueryCacheKey(
+    Solver &solver, const Expr &refinement_negated, const char *logic) {
+  string query, solvers;
+#if SOLVER_Z3
+  if (solver.z3) {
+    query += solver.z3->to_smt2();
+    solvers += "z3";
+  }
+#endif
+#if SOLVER_CVC5
+  if (refinement_negated.hasCVC5Term()) {
+    query += refinement_negated.getCVC5Term().toString();
+    solvers += "cvc5";
+  }
+#endif
+  return querycache::makeKey(query, solvers, logic);
+}
+
+static pair<CheckResult, int64_t> solve(
+    Solver &solver, const Expr &refinement_negated, const char *logic,
+    const string &dumpSMTPath, const string &dump_string_to_suffix) {
+  addQuery(solver, refinement_negated, dumpSMTPath, dump_string_to_suffix);
+
+  optional<string> cacheKey;
+  if (querycache::isOpen()) {
+    cacheKey = getQueryCacheKey(solver, refinement_negated, logic);
+    // Printing a counterexample needs a model, which the cache cannot give.
+    auto cached = querycache::lookup(*cacheKey, be_succinct.getValue());
+    if (cached) {
+      verbose("solve") << dump_string_to_suffix << ": cached\n";
+      auto result = CheckResult::fromCache(cached->isSat);
+      recordQuery(dump_string_to_suffix, logic, refinement_negated, result, 0);
+      return {result, 0};
+    }
+  }
 
   auto startTime = chrono::system_clock::now();
   CheckResult result = solver.check();
@@ -282,9 +478,147 @@ static pair<CheckResult, int64_t> solve(
       chrono::duration_cast<chrono::milliseconds>(
         chrono::system_clock::now() - startTime).count();
 
+  printWinner(result, dump_string_to_suffix, elapsedMillisec);
+  printResourceUnits(result, dump_string_to_suffix);
+  recordQuery(dump_string_to_suffix, logic, refinement_negated, result,
+              elapsedMillisec);
+
+  // A timeout depends on the limit, so only sat and unsat are cached
+  if (cacheKey && !result.isUnknown() && !result.isInconsistent())
+    querycache::store(*cacheKey, {result.hasSat()});
   return {result, elapsedMillisec};
 }
 
+// Check s again with the lazy constraints that the model of the last check
+// violates (see --lazy-associative), until the model satisfies all of them.
+// Then res holds under every constraint.
+// Only Z3 makes this pay off. A result without a model (e.g., cached or from
+// the external solver) can only be refined by adding every pending
+// constraint, and evaluating the constraints in a cvc5 model may solve the
+// query again.
+static void addLazyConstraints(
+    Solver &s, pair<CheckResult, int64_t> &res, vector<Expr> &pending,
+    const vector<Expr> &assumptions, const char *logic,
+    const string &dump_string_to_suffix) {
+  // Report how much of the eager precondition the query ended up with
+  size_t numConstraints = pending.size(), numAdded = 0;
+  Expr added = Expr::mkBool(true);
+  Defer sizePrinter([&]() {
+    if (!numConstraints)
+      return;
+    Expr all = added;
+    for (auto &c: pending)
+      all = all & c;
+    verbose("addLazyConstraints") << dump_string_to_suffix << ": added "
+        << numAdded << " of " << numConstraints << " constraints ("
+        << added.dagSize() << " of " << all.dagSize() << " terms)\n";
+  });
+
+  for (unsigned itr = 1; res.first.hasSat() && !pending.empty(); ++itr) {
+    vector<Expr> violated, satisfied;
+    if (res.first.isCached() ||
+        res.first.getWinner() == SolverType::EXTERNAL) {
+      violated = std::move(pending);
+    } else {
+      auto model = s.getModel();
+      for (auto &c: pending)
+        (model.eval(c, true).isTrue() ? satisfied : violated).push_back(c);
+    }
+    if (violated.empty())
+      return;
+    pending = std::move(satisfied);
+
+    verbose("addLazyConstraints") << dump_string_to_suffix << ": add "
+        << violated.size() << " violated constraints (" << pending.size()
+        << " left)\n";
+    Expr newlyAdded = Expr::mkBool(true);
+    for (auto &c: violated)
+      newlyAdded = newlyAdded & c;
+    s.add(newlyAdded);
+    added = added & newlyAdded;
+    numAdded += violated.size();
+
+    auto suffix = dump_string_to_suffix + ".lazy" + to_string(itr);
+    auto startTime = chrono::system_clock::now();
+    CheckResult result = assumptions.empty() ? s.check() :
+        s.check(assumptions);
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(
+        chrono::system_clock::now() - startTime).count();
+    printWinner(result, suffix, elapsed);
+    printResourceUnits(result, suffix);
+    recordQuery(suffix, logic, newlyAdded, result, elapsed);
+    res = {result, res.second + elapsed};
+  }
+}
+
+// The step names of --z3-tactic
+static const char *getStepName(VerificationStep step) {
+  switch (step) {
+  case VerificationStep::UB: return "ub";
+  case VerificationStep::RetValue: return "retval";
+  case VerificationStep::Memory: return "memory";
+  }
+  llvm_unreachable("unknown verification step");
+}
+
+// A part of the space of the dynamic dimension sizes (see --split-dims)
+struct DimCube {
+  // The dimensions that the cube fixes, and their sizes
+  vector<Expr> dims;
+  vector<Expr> sizes;
+  Expr constraint;
+  string desc;
+};
+
+// Splitting more dimensions would make too many queries
+static const unsigned MAX_DIM_CUBES = 64;
+
+static vector<DimCube> makeDimCubes(
+    const vector<Expr> &dynamicDims, unsigned numSizes) {
+  vector<DimCube> cubes = {{{}, {}, Expr::mkBool(true), ""}};
+  for (unsigned i = 0; i < dynamicDims.size(); ++i) {
+    if (cubes.size() * (numSizes + 1) > MAX_DIM_CUBES)
+      break;
+
+    auto &dim = dynamicDims[i];
+    string name = "dim" + to_string(i);
+    vector<DimCube> split;
+    for (auto &cube: cubes) {
+      for (unsigned sz = 0; sz <= numSizes; ++sz) {
+        DimCube c = cube;
+        if (!c.desc.empty())
+          c.desc += ", ";
+        if (sz < numSizes) {
+          c.dims.push_back(dim);
+          c.sizes.push_back(Index(sz));
+          c.constraint = c.constraint & (dim == sz);
+          c.desc += name + " = " + to_string(sz);
+        } else {
+          c.constraint = c.constraint & dim.uge(numSizes);
+          c.desc += name + " >= " + to_string(sz);
+        }
+        split.push_back(std::move(c));
+      }
+    }
+    cubes = std::move(split);
+  }
+  return cubes;
+}
+
+static bool reuseSMTContext = false;
+
+void setReuseSMTContext(bool reuse) {
+  reuseSMTContext = reuse;
+}
+
+// The number of functions that are validated at the same time (see -j). The
+// concurrent checks of the functions share the hardware threads.
+static unsigned numFunctionThreads = 1;
+
+static unsigned getNumCheckThreads() {
+  return max(thread::hardware_concurrency() / numFunctionThreads, 1u);
+}
+
 static const char *SMT_LOGIC_QF  = "QF_AUFBV";
 static const char *SMT_LOGIC     = "AUFBV";
 static const char *SMT_LOGIC_ALL = "ALL";
@@ -292,24 +626,33 @@ static const char *SMT_LOGIC_ALL = "ALL";
 static Results checkRefinement(
     const ValidationInput &vinput,
     const State &st_src, const State &st_tgt, Expr &&precond,
-    bool useAllLogic, int64_t &elapsedMillisec) {
+    vector<Expr> &&lazyConstraints, bool useAllLogic,
+    optional<Model> &counterExample, int64_t &elapsedMillisec) {
   mlir::func::FuncOp src = vinput.src;
   mlir::func::FuncOp tgt = vinput.tgt;
   auto fnname = src.getName().str();
+  stats::Timer buildTimer;
 
   auto printErrorMsg = [&](Solver &s, CheckResult res, const char *msg,
                            vector<Expr> &&params, VerificationStep step,
                            unsigned retidx = -1,
                            optional<mlir::Type> memElemType = nullopt){
     if (res.isUnknown()) {
-      llvm::outs() << "== Result: timeout ==\n";
+      tvOuts() << "== Result: timeout ==\n";
     } else if (res.hasSat()) {
-      llvm::outs() << "== Result: " << msg << "\n";
-
-      if (!be_succinct.getValue()) {
-        aop::evalConsts(s.getModel());
+      tvOuts() << "== Result: " << msg << "\n";
+
+      if (!be_succinct.getValue() &&
+          res.getWinner() == SolverType::EXTERNAL) {
+        // The in-process solver gave up, so there is no model to evaluate
+        // the counterexample with
+        tvOuts() << "\n<Model from " << extsolver::getName() << ">\n"
+                 << s.getExternalModel();
+      } else if (!be_succinct.getValue()) {
+        auto model = s.getModel();
+        aop::evalConsts(model);
         printCounterEx(
-            s.getModel(), params, src, tgt, st_src, st_tgt, step, retidx,
+            model, params, src, tgt, st_src, st_tgt, step, retidx,
             memElemType);
       }
     } else {
@@ -323,23 +666,35 @@ static Results checkRefinement(
         SMT_LOGIC : SMT_LOGIC_QF);
   verbose("checkRefinement") << "use logic: " << logic << "\n";
 
+  // A refinement obligation; its query is sat if the obligation is violated.
+  struct Query {
+    Expr notRefines;
+    string suffix;
+    string msg;
+    vector<Expr> params;
+    VerificationStep step;
+    unsigned retidx;
+    optional<mlir::Type> memElemType;
+    Results failure;
+  };
+  vector<Query> queries;
+  auto addRefinementQuery = [&](Expr &&not_refines, string &&suffix,
+      string &&msg, vector<Expr> &&params, VerificationStep step,
+      Results failure, unsigned retidx = -1,
+      optional<mlir::Type> memElemType = nullopt) {
+    // Instantiate the lazily encoded ops (see aop::instantiateLazyOps)
+    queries.push_back({not_refines.expandDefinitions().simplify(),
+        fnname + "." + suffix,
+        std::move(msg), std::move(params), step, retidx, memElemType,
+        failure});
+  };
+
   { // 1. Check UB
     verbose("checkRefinement") << "1. Check UB\n";
-    Solver s(logic);
-    auto not_refines =
-        (st_src.isWellDefined() & !st_tgt.isWellDefined()).simplify();
-    auto res = solve(s, precond & not_refines, vinput.dumpSMTPath,
-                     fnname + ".1.ub");
-    elapsedMillisec += res.second;
-    if (res.first.isInconsistent()) {
-      llvm::outs() << "== Result: inconsistent output!!"
-                      " either MLIR-TV or SMT solver has a bug ==\n";
-      return Results::INCONSISTENT;
-    } else if (!res.first.hasUnsat()) {
-      printErrorMsg(s, res.first, "Source is more defined than target", {},
-                    VerificationStep::UB);
-      return res.first.hasSat() ? Results::UB : Results::TIMEOUT;
-    }
+    auto not_refines = st_src.isWellDefined() & !st_tgt.isWellDefined();
+    addRefinementQuery(std::move(not_refines), "1.ub",
+        "Source is more defined than target", {}, VerificationStep::UB,
+        Results::UB);
   }
 
   if (st_src.retValues.size() != 0) { // 2. Check the return values
@@ -347,62 +702,198 @@ static Results checkRefinement(
     unsigned numret = st_src.retValues.size();
     assert(numret == st_tgt.retValues.size());
     for (unsigned i = 0; i < numret; ++i) {
-      Solver s(logic);
-
       auto [refines, params] =
           ::refines(st_tgt.retValues[i], st_src.retValues[i]);
 
       auto not_refines =
-        (st_src.isWellDefined() & st_tgt.isWellDefined() & !refines)
-        .simplify();
-      auto res = solve(s, precond & not_refines, vinput.dumpSMTPath,
-                      fnname + ".2.retval." + to_string(i));
-      elapsedMillisec += res.second;
-
-      if (res.first.isInconsistent()) {
-        llvm::outs() << "== Result: inconsistent output!!"
-                        " either MLIR-TV or SMT solver has a bug ==\n";
-        return Results::INCONSISTENT;
-      } else if (!res.first.hasUnsat()) {
-        string msg = "Return value mismatch";
-        if (numret != 1)
-          msg = msg + " (" + to_string(i + 1) + "/" + to_string(numret) + ")";
-
-        printErrorMsg(s, res.first, msg.c_str(), std::move(params),
-                      VerificationStep::RetValue, i);
-        return res.first.hasSat() ? Results::RETVALUE : Results::TIMEOUT;
-      }
+        st_src.isWellDefined() & st_tgt.isWellDefined() & !refines;
+      string msg = "Return value mismatch";
+      if (numret != 1)
+        msg = msg + " (" + to_string(i + 1) + "/" + to_string(numret) + ")";
+
+      addRefinementQuery(std::move(not_refines),
+          "2.retval." + to_string(i), std::move(msg), std::move(params),
+          VerificationStep::RetValue, Results::RETVALUE, i);
     }
   }
 
   if (st_src.m->getTotalNumBlocks() > 0 ||
       st_tgt.m->getTotalNumBlocks() > 0) { // 3. Check memory refinement
     verbose("checkRefinement") << "3. Check memory refinement\n";
-    Solver s(logic);
-    auto refinementPerType = st_tgt.m->refines(*st_src.m);
-    // [refines, params]
-    for (auto &[elementType, refinement]: refinementPerType) {
-      Expr refines = refinement.first;
-      auto &params = refinement.second;
+    if (arg_split_memory_checks.getValue()) {
+      // A small query per block instead of one over every block
+      auto refinementPerType = st_tgt.m->refinesPerBlock(*st_src.m);
+      for (auto &[elementType, refinementPerBlock]: refinementPerType) {
+        for (unsigned bid = 0; bid < refinementPerBlock.size(); ++bid) {
+          auto &[refines, params] = refinementPerBlock[bid];
+          auto not_refines =
+            st_src.isWellDefined() & st_tgt.isWellDefined() & !refines;
+          addRefinementQuery(std::move(not_refines),
+              "3.memory." + to_string(elementType) + ".block" +
+                to_string(bid),
+              "Memory mismatch (block " + to_string(bid) + ")",
+              std::move(params), VerificationStep::Memory, Results::RETVALUE,
+              -1, elementType);
+        }
+      }
+    } else {
+      auto refinementPerType = st_tgt.m->refines(*st_src.m);
+      // [refines, params]
+      for (auto &[elementType, refinement]: refinementPerType) {
+        Expr refines = refinement.first;
+        auto &params = refinement.second;
+
+        auto not_refines =
+          st_src.isWellDefined() & st_tgt.isWellDefined() & !refines;
+        addRefinementQuery(std::move(not_refines),
+            "3.memory." + to_string(elementType), "Memory mismatch",
+            std::move(params), VerificationStep::Memory, Results::RETVALUE,
+            -1, elementType);
+      }
+    }
+  }
 
-      auto not_refines =
-        (st_src.isWellDefined() & st_tgt.isWellDefined() & !refines).simplify();
-      auto res = solve(s, precond & not_refines, vinput.dumpSMTPath,
-                      fnname + ".3.memory." + to_string(elementType));
-      elapsedMillisec += res.second;
-      if (res.first.isInconsistent()) {
-        llvm::outs() << "== Result: inconsistent output!!"
-                        " either MLIR-TV or SMT solver has a bug ==\n";
-        return Results::INCONSISTENT;
-
-      } else if (!res.first.hasUnsat()) {
-        printErrorMsg(s, res.first, "Memory mismatch", std::move(params),
-                      VerificationStep::Memory, -1, elementType);
-        return res.first.hasSat() ? Results::RETVALUE : Results::TIMEOUT;
+  if (arg_split_dims.getValue() > 0 && !st_src.dynamicDims.empty()) {
+    // Cube-and-conquer: a query is unsat if it is unsat in every cube. The
+    // sizes that a cube fixes are substituted, so that the solver sees
+    // concrete shapes.
+    auto cubes = makeDimCubes(st_src.dynamicDims, arg_split_dims.getValue());
+    verbose("checkRefinement") << "split each query into " << cubes.size()
+        << " cubes over the dynamic dimensions\n";
+    vector<Query> split;
+    for (auto &q: queries) {
+      for (unsigned i = 0; i < cubes.size(); ++i) {
+        Query c = q;
+        c.notRefines = (q.notRefines.substitute(cubes[i].dims, cubes[i].sizes)
+            & cubes[i].constraint).simplify();
+        c.suffix += ".cube" + to_string(i);
+        verbose("checkRefinement") << c.suffix << ": " << cubes[i].desc
+            << "\n";
+        split.push_back(std::move(c));
+      }
+    }
+    queries = std::move(split);
+  }
+
+  stats::addIterationTime("build_queries", buildTimer.getMs());
+
+  // Returns a result if q is not unsat.
+  auto checkResult = [&](Query &q, Solver &s, const CheckResult &res)
+      -> optional<Results> {
+    if (res.isInconsistent()) {
+      tvOuts() << "== Result: inconsistent output!!"
+                      " either MLIR-TV or SMT solver has a bug ==\n";
+      return Results(Results::INCONSISTENT);
+    } else if (!res.hasUnsat()) {
+      // Keep the model for refining the abstraction (see --refine-per-op)
+      if (res.hasSat() && !res.isCached() &&
+          res.getWinner() != SolverType::EXTERNAL)
+        counterExample = s.getModel();
+      printErrorMsg(s, res, q.msg.c_str(), std::move(q.params),
+                    q.step, q.retidx, q.memElemType);
+      return res.hasSat() ? q.failure : Results::TIMEOUT;
+    }
+    return nullopt;
+  };
+
+  // The split memory checks and the cubes are many small queries that are
+  // meant to be solved at the same time.
+  if ((arg_parallel_checks.getValue() || arg_split_memory_checks.getValue() ||
+       arg_split_dims.getValue() > 0) &&
+      Solver::canCheckConcurrently()) {
+    // The queries are solved at once, so there are no models to instantiate
+    // the lazy constraints with.
+    for (auto &c: lazyConstraints)
+      precond = precond & c;
+
+    vector<unique_ptr<Solver>> solvers;
+    vector<Solver *> solverPtrs;
+    for (auto &q: queries) {
+      solvers.push_back(make_unique<Solver>(logic, getStepName(q.step)));
+      addQuery(*solvers.back(), precond & q.notRefines, vinput.dumpSMTPath,
+               q.suffix);
+      solverPtrs.push_back(solvers.back().get());
+    }
+    unsigned numThreads = getNumCheckThreads();
+    verbose("checkRefinement") << "check " << queries.size()
+        << " queries concurrently on " << numThreads << " threads\n";
+
+    auto startTime = chrono::system_clock::now();
+    auto results = Solver::checkConcurrently(solverPtrs, numThreads);
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(
+        chrono::system_clock::now() - startTime).count();
+    elapsedMillisec += elapsed;
+    stats::addIterationTime("parallel_checks", elapsed);
+    for (size_t i = 0; i < queries.size(); ++i) {
+      recordQuery(queries[i].suffix, logic, precond & queries[i].notRefines,
+                  results[i], nullopt);
+    }
+
+    // Report the first violated obligation, as the sequential checks do.
+    for (size_t i = 0; i < queries.size(); ++i) {
+      if (results[i].hasUnsat() && !results[i].isInconsistent())
+        continue;
+      // The later queries that did not finish were interrupted
+      size_t numStopped = count_if(results.begin() + i + 1, results.end(),
+          [](const CheckResult &r) { return r.isUnknown(); });
+      verbose("checkRefinement") << queries[i].suffix << " is not unsat; "
+          << numStopped << " later queries were stopped\n";
+      return *checkResult(queries[i], *solvers[i], results[i]);
+    }
+    return Results::SUCCESS;
+  }
+
+  if (arg_incremental_checks.getValue()) {
+    // Every obligation conjoins the well-definedness of src, so it is
+    // asserted once with the precondition. Each obligation is checked under
+    // an assumption literal that implies it.
+    // The solver checks every step, so only the --z3-tactic pipelines for
+    // any step apply.
+    Solver s(logic);
+    s.add(precond & st_src.isWellDefined().expandDefinitions());
+    unsigned numChecked = 0;
+    for (auto &q: queries) {
+      verbose("checkRefinement") << q.suffix << ": check under an assumption"
+          " after " << numChecked++ << " obligations in the same solver\n";
+      if (!vinput.dumpSMTPath.empty()) {
+        Solver dumpSolver(logic);
+        addQuery(dumpSolver, precond & q.notRefines, vinput.dumpSMTPath,
+                 q.suffix);
       }
+      auto lit = Expr::mkFreshVar(Sort::boolSort(), "obligation");
+      s.add(lit.implies(q.notRefines));
+
+      auto startTime = chrono::system_clock::now();
+      CheckResult res = s.check({lit});
+      auto elapsed = chrono::duration_cast<chrono::milliseconds>(
+          chrono::system_clock::now() - startTime).count();
+      printWinner(res, q.suffix, elapsed);
+      printResourceUnits(res, q.suffix);
+      recordQuery(q.suffix, logic, q.notRefines, res, elapsed);
+
+      // The added constraints are valid, so the later obligations keep them.
+      pair<CheckResult, int64_t> resAndTime = {res, elapsed};
+      addLazyConstraints(s, resAndTime, lazyConstraints, {lit}, logic,
+                         q.suffix);
+      elapsedMillisec += resAndTime.second;
+
+      if (auto failed = checkResult(q, s, resAndTime.first))
+        return *failed;
     }
+    return Results::SUCCESS;
   }
 
+  for (auto &q: queries) {
+    Solver s(logic, getStepName(q.step));
+    auto res = solve(s, precond & q.notRefines, logic, vinput.dumpSMTPath,
+                     q.suffix);
+    auto pending = lazyConstraints;
+    addLazyConstraints(s, res, pending, {}, logic, q.suffix);
+    elapsedMillisec += res.second;
+
+    if (auto failed = checkResult(q, s, res.first))
+      return *failed;
+  }
   return Results::SUCCESS;
 }
 
@@ -414,18 +905,18 @@ static void printUnsupported(const UnsupportedException &ue) {
     mlir::Operation *op = get<0>(obj);
 
     if (op == nullptr) {
-      llvm::errs() << "This function is not supported.\n";
+      tvErrs() << "This function is not supported.\n";
     } else {
-      llvm::errs() << "Unknown op (" << op->getName() << "): " << *op << "\n";
+      tvErrs() << "Unknown op (" << op->getName() << "): " << *op << "\n";
     }
     if (!reason.empty())
-      llvm::errs() << "\t" << reason << "\n";
+      tvErrs() << "\t" << reason << "\n";
 
   } else {
     mlir::Type ty = get<1>(obj);
-    llvm::errs() << "Unsupported type: " << ty << "\n";
+    tvErrs() << "Unsupported type: " << ty << "\n";
     if (!reason.empty())
-      llvm::errs() << "\t" << reason << "\n";
+      tvErrs() << "\t" << reason << "\n";
   }
 }
 
@@ -437,7 +928,7 @@ static State encodeFinalState(
   State st = createInputState(fn, std::move(initMem), args, preconds);
 
   if (printOps)
-    llvm::outs() << (issrc ? "<src>" : "<tgt>") << "\n";
+    tvOuts() << (issrc ? "<src>" : "<tgt>") << "\n";
 
   encode(st, fn, printOps);
 
@@ -453,6 +944,7 @@ Expr exprAnd(const vector<Expr>& v) {
   return e;
 }
 
+// The precondition does not include the preconditions of the abstract ops.
 static tuple<State, State, Expr> encodeFinalStates(
     const ValidationInput &vinput, bool printOps) {
   auto src = vinput.src, tgt = vinput.tgt;
@@ -476,27 +968,49 @@ static tuple<State, State, Expr> encodeFinalStates(
   State st_tgt = encodeFinalState(
       vinput, std::move(initMemTgt), printOps, false, args, preconds);
 
-  preconds.push_back(aop::getFpConstantPrecondition());
-
-  if (aop::getFpAddAssociativity())
-    preconds.push_back(aop::getFpAssociativePrecondition());
-
-  if (aop::getFpCastIsPrecise())
-    preconds.push_back(aop::getFpTruncatePrecondition());
-
   Expr precond =
       exprAnd(preconds) & st_src.precondition() & st_tgt.precondition();
-  precond = precond.simplify();
 
   return {std::move(st_src), std::move(st_tgt), std::move(precond)};
 }
 
+// If enc is empty, encode src and tgt into it. Otherwise, its lazily encoded
+// ops are instantiated under the current abstraction.
+// If the validation fails with a counterexample, counterExample is its model.
 static Results tryValidation(
-    const ValidationInput &vinput, bool printOps, bool useAllLogic,
+    const ValidationInput &vinput, optional<tuple<State, State, Expr>> &enc,
+    bool printOps, bool useAllLogic, optional<Model> &counterExample,
     int64_t &elapsedMillisec) {
-  auto enc = encodeFinalStates(vinput, printOps);
+  stats::Timer timer;
+  if (!enc) {
+    enc = encodeFinalStates(vinput, printOps);
+    stats::addIterationTime("encode", timer.getMs());
+  } else {
+    verbose("tryValidation") << "reuse the encoding\n";
+  }
+
+  timer = stats::Timer();
+  aop::instantiateLazyOps();
+
+  vector<Expr> preconds = {get<2>(*enc), aop::getFpConstantPrecondition()};
+  vector<Expr> lazyConstraints;
+
+  if (aop::getFpAddAssociativity()) {
+    if (arg_lazy_associative.getValue())
+      lazyConstraints = aop::getFpAssociativeConstraints();
+    else
+      preconds.push_back(aop::getFpAssociativePrecondition());
+  }
+
+  if (aop::getFpCastIsPrecise())
+    preconds.push_back(aop::getFpTruncatePrecondition());
+
+  Expr precond = exprAnd(preconds).expandDefinitions().simplify();
+  stats::addIterationTime("instantiate", timer.getMs());
+
   return checkRefinement(
-        vinput, get<0>(enc), get<1>(enc), std::move(get<2>(enc)), useAllLogic,
+        vinput, get<0>(*enc), get<1>(*enc), std::move(precond),
+        std::move(lazyConstraints), useAllLogic, counterExample,
         elapsedMillisec);
 }
 
@@ -527,6 +1041,7 @@ static void checkIsSrcAlwaysUB(
       vinput.f64NonConstsCount, vinput.f64Consts, vinput.f64HasInfOrNaN);
   aop::setEncodingOptions(vinput.useMultisetForFpSum);
 
+  stats::Timer encodeTimer;
   ArgInfo args_dummy;
   vector<Expr> preconds;
   // Set blocks as initially alive, since making them dead always makes the
@@ -537,37 +1052,78 @@ static void checkIsSrcAlwaysUB(
       /*blocks initially alive*/true);
   auto st = encodeFinalState(vinput, std::move(initMemory), false, true,
       args_dummy, preconds);
+  stats::addIterationTime("always_ub_encode", encodeTimer.getMs());
 
   useAllLogic |= st.hasConstArray;
   auto logic = useAllLogic ? SMT_LOGIC_ALL :
       (st.hasQuantifier ? SMT_LOGIC : SMT_LOGIC_QF);
   verbose("checkIsSrcAlwaysUB") << "use logic: " << logic << "\n";
 
-  Solver s(logic);
+  Solver s(logic, "notub");
   auto not_ub = st.isWellDefined().simplify();
-  auto smtres = solve(s, exprAnd(preconds) & not_ub, vinput.dumpSMTPath,
+  auto smtres = solve(s, exprAnd(preconds) & not_ub, logic, vinput.dumpSMTPath,
                       fnname + ".notub");
   elapsedMillisec += smtres.second;
 
   if (smtres.first.isInconsistent()) {
-    llvm::outs() << "== Result: inconsistent output!!"
+    tvOuts() << "== Result: inconsistent output!!"
                     " either MLIR-TV or SMT solver has a bug ==\n";
   } else if (smtres.first.hasUnsat()) {
-    llvm::outs() << "== Result: correct (source is always undefined) ==\n";
+    tvOuts() << "== Result: correct (source is always undefined) ==\n";
+  } else if (wasSuccess && vinput.isSyntacticallyIdentical) {
+    tvOuts() << "== Result: correct (syntactically identical) ==\n";
   } else if (wasSuccess) {
-    llvm::outs() << "== Result: correct ==\n";
+    tvOuts() << "== Result: correct ==\n";
+  }
+}
+
+static vector<pair<string, string>> describeAbstraction(
+    const aop::Abstraction &abs) {
+  auto str = [](auto level) {
+    string s;
+    llvm::raw_string_ostream os(s);
+    os << level;
+    return os.str();
+  };
+  return {{"fp_dot", str(abs.fpDot)}, {"fp_cast", str(abs.fpCast)},
+          {"fp_add_sum", str(abs.fpAddSumEncoding)},
+          {"int_dot", str(abs.intDot)}};
+}
+
+// The shape of a function pair in the abstraction profile: the signature, the
+// kinds of the ops in src and tgt, the number of distinct fp values, and the
+// options that change how the abstraction is refined. The fp counts keep the
+// runs with different --fp-bits apart.
+static string describeShape(const ValidationInput &vinput) {
+  string desc;
+  llvm::raw_string_ostream os(desc);
+  os << vinput.src.getFunctionType() << "\n";
+  for (auto fn: {vinput.src, vinput.tgt}) {
+    map<string, unsigned> opKinds;
+    fn.walk([&](mlir::Operation *op) {
+      opKinds[op->getName().getStringRef().str()]++;
+    });
+    for (auto &[name, count]: opKinds)
+      os << name << " " << count << "\n";
+    os << "\n";
   }
+  os << vinput.isFpAddAssociative << vinput.useMultisetForFpSum
+     << vinput.unrollIntSum << no_arith_properties.getValue()
+     << use_concrete_fp_encoding.getValue() << " "
+     << arg_unroll_fp_sum_bound.getValue() << " "
+     << vinput.f32NonConstsCount << " " << vinput.f64NonConstsCount;
+  return os.str();
 }
 
 static Results validate(ValidationInput vinput) {
-  llvm::outs() << "=========== Function "
+  tvOuts() << "=========== Function "
       << vinput.src.getName() << " ===========\n\n";
   if (vinput.src.getNumArguments() != vinput.tgt.getNumArguments())
     throw UnsupportedException("source, target has different num arguments");
 
   int64_t elapsedMillisec = 0;
   Defer timePrinter([&]() {
-    llvm::outs() << "solver's running time: " << elapsedMillisec
+    tvOuts() << "solver's running time: " << elapsedMillisec
         << " msec.\n\n";
   });
   using namespace aop;
@@ -576,7 +1132,7 @@ static Results validate(ValidationInput vinput) {
   });
 
   auto printSematics = [](Abstraction &abs, Results &result) {
-    llvm::outs()
+    tvOuts()
       << "\n--------------------------------------------------------------\n"
       << "  Abstractions used for the validation:\n"
       << "  - dot ops (fp): " << abs.fpDot << "\n"
@@ -592,36 +1148,81 @@ static Results validate(ValidationInput vinput) {
   auto useAllLogic = arg_smt_use_all_logic.getValue()
       || use_concrete_fp_encoding.getValue();
   queue<Abstraction> queue;
-
-  queue.push({AbsLevelFpDot::FULLY_ABS,
+  const Abstraction mostAbstractAbs = {AbsLevelFpDot::FULLY_ABS,
       AbsLevelFpCast::FULLY_ABS,
       AbsLevelIntDot::FULLY_ABS,
       vinput.isFpAddAssociative ? AbsFpAddSumEncoding::USE_SUM_ONLY :
-                  AbsFpAddSumEncoding::DEFAULT});
+                  AbsFpAddSumEncoding::DEFAULT};
+  Abstraction initialAbs = mostAbstractAbs;
+
+  if (vinput.isSyntacticallyIdentical) {
+    // A function trivially refines itself, so the refinement is not checked.
+    // src may still be always undefined, and encoding it for that query also
+    // reports the unsupported ops. This one query remains per pair.
+    resetAbstractlyEncodedAttrs();
+    checkIsSrcAlwaysUB(vinput, true, useAllLogic, elapsedMillisec);
+    return Results::SUCCESS;
+  }
 
+  optional<string> profileKey;
+  optional<absprofile::Entry> profile;
+  // --refine-per-op refines the ops one by one, which a global abstraction
+  // cannot record
+  if (absprofile::isOpen() && !arg_refine_per_op.getValue()) {
+    profileKey = absprofile::makeKey(describeShape(vinput));
+    profile = absprofile::lookup(*profileKey);
+    if (profile) {
+      tvOuts() << "Starting at the abstraction in the profile, which skips "
+               << profile->iterations << " refinement iterations\n";
+      initialAbs = profile->abs;
+    }
+  }
+  queue.push(initialAbs);
 
   setEncodingOptions(vinput.useMultisetForFpSum);
   resetAbstractlyEncodedAttrs();
 
   unsigned itrCount = 0;
+  // The iteration and the solver time at which the refinement from
+  // initialAbs started
+  unsigned startItrCount = 0;
+  int64_t startMillisec = elapsedMillisec;
   const string dumpSMTPath = vinput.dumpSMTPath;
+  // The encoding is reused by the iterations whose abstraction only changes
+  // the ops that were encoded lazily.
+  optional<tuple<State, State, Expr>> enc;
 
   while (!queue.empty()) {
     auto abs = queue.front();
     queue.pop();
 
-    if (itrCount > 0)
-      llvm::outs() << "Validating the transformation with a refined "
+    if (itrCount > startItrCount)
+      tvOuts() << "Validating the transformation with a refined "
           "abstraction...\n";
 
-    setAbstraction(abs,
-        vinput.isFpAddAssociative,
-        vinput.unrollIntSum,
-        no_arith_properties.getValue(),
-        use_concrete_fp_encoding.getValue(),
-        arg_unroll_fp_sum_bound.getValue(),
-        vinput.f32NonConstsCount, vinput.f32Consts, vinput.f32HasInfOrNaN,
-        vinput.f64NonConstsCount, vinput.f64Consts, vinput.f64HasInfOrNaN);
+    bool reuseEncoding = enc && canReabstract(abs);
+    if (stats::isEnabled())
+      stats::beginIteration(describeAbstraction(abs), reuseEncoding);
+
+    if (reuseEncoding) {
+      reabstract(abs);
+    } else {
+      if (enc)
+        // The fp encodings themselves depend on the fp cast abstraction, so
+        // changing it cannot reuse the encoding
+        verbose("validate") << "encode again: the fp cast abstraction changed"
+                               " or the ops were encoded eagerly\n";
+      enc.reset();
+      setAbstraction(abs,
+          vinput.isFpAddAssociative,
+          vinput.unrollIntSum,
+          no_arith_properties.getValue(),
+          use_concrete_fp_encoding.getValue(),
+          arg_unroll_fp_sum_bound.getValue(),
+          vinput.f32NonConstsCount, vinput.f32Consts, vinput.f32HasInfOrNaN,
+          vinput.f64NonConstsCount, vinput.f64Consts, vinput.f64HasInfOrNaN);
+      setLazyEncoding(!arg_no_lazy_encoding.getValue());
+    }
 
     if (!dumpSMTPath.empty()) {
       vinput.dumpSMTPath = dumpSMTPath;
@@ -630,11 +1231,38 @@ static Results validate(ValidationInput vinput) {
     }
 
     bool printOps = itrCount == 0 && !be_succinct.getValue();
-    auto res = tryValidation(vinput, printOps, useAllLogic, elapsedMillisec);
+    optional<Model> counterExample;
+    int64_t futileMillisec = elapsedMillisec;
+    auto res = tryValidation(vinput, enc, printOps, useAllLogic,
+                             counterExample, elapsedMillisec);
     printSematics(abs, res);
     if (res.code == Results::INCONSISTENT) {
       return res;
+    } else if (res.code == Results::TIMEOUT && profile &&
+               itrCount == startItrCount) {
+      // The abstraction in the profile is too precise for this function.
+      // A more abstract one cannot be sat if this one is unsat, so only a
+      // timeout is worth starting over at the most abstract one.
+      tvOuts() << "The abstraction in the profile timed out; starting at the"
+                  " most abstract one\n";
+      absprofile::invalidate(*profileKey, *profile);
+      profile.reset();
+      initialAbs = mostAbstractAbs;
+      queue.push(initialAbs);
+      enc.reset();
+      startItrCount = ++itrCount;
+      startMillisec = elapsedMillisec;
+      continue;
     } else if (res.code == Results::SUCCESS) {
+      // Record the abstraction if it had to be refined. The iterations are
+      // counted from the most abstract one.
+      if (profileKey &&
+          describeAbstraction(abs) != describeAbstraction(initialAbs)) {
+        absprofile::store(*profileKey, {abs,
+            (profile ? profile->iterations : 0) + itrCount - startItrCount,
+            (profile ? profile->solverMs : 0) +
+                (uint64_t)(futileMillisec - startMillisec)});
+      }
       checkIsSrcAlwaysUB(vinput, res.code == Results::SUCCESS,
           useAllLogic, elapsedMillisec);
       return res;
@@ -669,9 +1297,7 @@ static Results validate(ValidationInput vinput) {
       }
     }
 
-    if (isChanged) {
-      queue.push(nextAbs);
-    } else {
+    if (!isChanged) {
       /* 4. fp add, sum encoding level */
       // Since UNROLL_TO_ADD may cause big slowdown, turn in off at the end
       // only.
@@ -681,11 +1307,31 @@ static Results validate(ValidationInput vinput) {
       if (abs.fpAddSumEncoding == AbsFpAddSumEncoding::DEFAULT) {
         if (usedOps.fpSum) {
           nextAbs.fpAddSumEncoding = AbsFpAddSumEncoding::UNROLL_TO_ADD;
-          queue.push(nextAbs);
+          isChanged = true;
         }
       }
     }
 
+    if (isChanged && arg_refine_per_op.getValue() && counterExample &&
+        enc && canReabstract(nextAbs)) {
+      // Refine only the ops whose abstraction the counterexample relies on,
+      // and keep the abstraction of the others. Once no op is found, the
+      // abstraction of every op is refined.
+      auto ops = findSpuriousLazyOps(*counterExample, nextAbs);
+      auto numOps = getNumLazyOpsToRefine(nextAbs);
+      if (!ops.empty() && ops.size() < numOps) {
+        tvOuts() << "Refining the abstraction of " << ops.size() << " of "
+                 << numOps << " ops\n";
+        refineLazyOps(ops, nextAbs);
+        queue.push(abs);
+        ++itrCount;
+        continue;
+      }
+    }
+
+    if (isChanged)
+      queue.push(nextAbs);
+
     ++itrCount;
   }
 
@@ -741,9 +1387,215 @@ static vector<mlir::memref::GlobalOp> mergeGlobals(
   return mergedGlbs;
 }
 
+// Returns true if src and tgt are identical up to the names of SSA values and
+// locations, and the globals that they use are identically defined.
+static bool isSyntacticallyIdentical(
+    mlir::func::FuncOp src, mlir::func::FuncOp tgt,
+    const AnalysisResult &src_res, const AnalysisResult &tgt_res) {
+  using mlir::OperationEquivalence;
+  auto &srcGlobals = src_res.memref.usedGlobals;
+  auto &tgtGlobals = tgt_res.memref.usedGlobals;
+  if (srcGlobals.size() != tgtGlobals.size())
+    return false;
+
+  for (auto &[name, glbSrc0]: srcGlobals) {
+    auto tgtItr = tgtGlobals.find(name);
+    if (tgtItr == tgtGlobals.end())
+      return false;
+
+    auto glbSrc = glbSrc0, glbTgt = tgtItr->second; // Remove constness
+    if (!OperationEquivalence::isEquivalentTo(glbSrc, glbTgt,
+            OperationEquivalence::IgnoreLocations))
+      return false;
+  }
+
+  return OperationEquivalence::isEquivalentTo(src, tgt,
+      OperationEquivalence::IgnoreLocations);
+}
+
+static Results analyzeAndValidate(
+    mlir::func::FuncOp srcfn, mlir::func::FuncOp tgtfn, bool &hasUnsupported) {
+  AnalysisResult src_res, tgt_res;
+  vector<mlir::memref::GlobalOp> globals;
+
+  try {
+    stats::Timer timer;
+    src_res = analyze(srcfn);
+    tgt_res = analyze(tgtfn);
+    stats::addFunctionTime("analysis", timer.getMs());
+    globals = mergeGlobals(
+        src_res.memref.usedGlobals, tgt_res.memref.usedGlobals);
+  } catch (UnsupportedException ue) {
+    printUnsupported(ue);
+    hasUnsupported = true;
+    return Results::SUCCESS;
+  }
+
+  auto f32_consts = src_res.F32.constSet;
+  f32_consts.merge(tgt_res.F32.constSet);
+  auto f64_consts = src_res.F64.constSet;
+  f64_consts.merge(tgt_res.F64.constSet);
+
+  ValidationInput vinput;
+  vinput.src = srcfn;
+  vinput.tgt = tgtfn;
+  vinput.dumpSMTPath = arg_dump_smt_to.getValue();
+  vinput.globals = globals;
+
+  vinput.numBlocksPerType = src_res.memref.argCount;
+  for (auto &[ty, cnt]: src_res.memref.varCount)
+    vinput.numBlocksPerType[ty] += cnt;
+  for (auto &[ty, cnt]: tgt_res.memref.varCount)
+    vinput.numBlocksPerType[ty] += cnt;
+
+  if (vinput.numBlocksPerType.size() > 1) {
+    tvOuts() << "NOTE: mlir-tv assumes that memrefs of different element "
+        "types do not alias. This can cause missing bugs.\n";
+  }
+
+  if (num_memblocks.getValue() != 0) {
+    for (auto &[_, cnt]: vinput.numBlocksPerType)
+      cnt = num_memblocks.getValue();
+  }
+
+  if (fp_bits.getValue() != 0) {
+    assert(fp_bits.getValue() < 32 && "Given fp bits are too large");
+    vinput.f32NonConstsCount = vinput.f64NonConstsCount =
+        1u << fp_bits.getValue();
+  } else {
+    // Count non-constant floating points whose absolute values are distinct.
+    auto countNonConstFps = [](const auto& src_res, const auto& tgt_res,
+        bool elemwise) {
+      if (elemwise) {
+        return src_res.argCount + // # of variables in argument lists
+          src_res.varCount + tgt_res.varCount; // # of variables in registers
+      } else {
+        return src_res.argCount + // # of variables in argument lists
+          src_res.varCount + tgt_res.varCount + // # of variables in registers
+          src_res.elemsCount + tgt_res.elemsCount;
+              // # of ShapedType elements count
+      }
+    };
+
+    auto isElementwise = src_res.isElementwiseFPOps ||
+                         tgt_res.isElementwiseFPOps;
+    vinput.f32NonConstsCount =
+        countNonConstFps(src_res.F32, tgt_res.F32, isElementwise);
+    vinput.f64NonConstsCount =
+        countNonConstFps(src_res.F64, tgt_res.F64, isElementwise);
+  }
+  vinput.f32Consts = f32_consts;
+  vinput.f32HasInfOrNaN = src_res.F32.hasInfOrNaN | tgt_res.F32.hasInfOrNaN;
+  vinput.f64Consts = f64_consts;
+  vinput.f64HasInfOrNaN = src_res.F64.hasInfOrNaN | tgt_res.F64.hasInfOrNaN;
+  vinput.isFpAddAssociative = arg_fp_add_associative.getValue();
+  vinput.unrollIntSum = arg_unroll_int_sum.getValue();
+  vinput.useMultisetForFpSum = arg_multiset.getValue();
+  vinput.isSyntacticallyIdentical = !arg_no_syntactic_check.getValue() &&
+      isSyntacticallyIdentical(srcfn, tgtfn, src_res, tgt_res);
+
+  try {
+    return validate(vinput);
+  } catch (UnsupportedException ue) {
+    printUnsupported(ue);
+    hasUnsupported = true;
+  }
+  return Results::SUCCESS;
+}
+
+static const char *toString(Results::Code code) {
+  switch (code) {
+  case Results::SUCCESS: return "SUCCESS";
+  case Results::TIMEOUT: return "TIMEOUT";
+  case Results::RETVALUE: return "RETVALUE";
+  case Results::UB: return "UB";
+  case Results::INCONSISTENT: return "INCONSISTENT";
+  }
+  llvm_unreachable("Unknown result");
+}
+
+// Validate the function pair and record its stats (see --stats-json)
+static Results validateFunction(
+    mlir::func::FuncOp srcfn, mlir::func::FuncOp tgtfn, bool &hasUnsupported) {
+  if (!stats::isEnabled())
+    return analyzeAndValidate(srcfn, tgtfn, hasUnsupported);
+
+  stats::beginFunction(srcfn.getName().str());
+  stats::Timer timer;
+  double simplifyTime = smt::getSimplifyTimeMs();
+  bool isUnsupported = false;
+
+  auto result = analyzeAndValidate(srcfn, tgtfn, isUnsupported);
+
+  stats::addFunctionTime("simplify", smt::getSimplifyTimeMs() - simplifyTime);
+  stats::addFunctionTime("total", timer.getMs());
+  stats::endFunction(isUnsupported ? "UNSUPPORTED" : toString(result.code));
+  hasUnsupported |= isUnsupported;
+  return result;
+}
+
+using FnPair = pair<mlir::func::FuncOp, mlir::func::FuncOp>;
+
+// The encoding state below holds expressions in thread-local variables. It
+// must be released before the SMT context of the expressions is destroyed.
+static void releaseThreadLocalExprs() {
+  aop::clearAbstractions();
+  resetAbstractlyEncodedAttrs();
+  resetDeclaredFunctions();
+}
+
+// Validate the function pairs on numThreads worker threads.
+// Each worker owns an SMT context and has its own abstraction state, and the
+// output of each function is buffered and printed in the order of fnPairs.
+static Results validateInParallel(
+    const vector<FnPair> &fnPairs, unsigned numThreads,
+    bool &hasUnsupported) {
+  struct FnResult {
+    string outs, errs;
+    Results result;
+    bool hasUnsupported = false;
+  };
+  vector<FnResult> fnResults(fnPairs.size());
+  atomic<size_t> nextFn(0);
+  auto ctxConfig = smt::getContextConfig();
+
+  auto worker = [&]() {
+    auto ctx = smt::makeContext(ctxConfig);
+    smt::ContextScope scope(*ctx);
+    auto release = llvm::make_scope_exit(releaseThreadLocalExprs);
+
+    size_t i;
+    while ((i = nextFn++) < fnPairs.size()) {
+      auto &res = fnResults[i];
+      llvm::raw_string_ostream os(res.outs), es(res.errs);
+      redirectOutputs(&os, &es);
+      res.result = validateFunction(
+          fnPairs[i].first, fnPairs[i].second, res.hasUnsupported);
+      redirectOutputs(nullptr, nullptr);
+      os.flush();
+      es.flush();
+    }
+  };
+
+  vector<thread> threads;
+  for (unsigned i = 0; i < numThreads; ++i)
+    threads.emplace_back(worker);
+  for (auto &t: threads)
+    t.join();
+
+  Results verificationResult = Results::SUCCESS;
+  for (auto &res: fnResults) {
+    tvOuts() << res.outs;
+    tvErrs() << res.errs;
+    verificationResult.merge(res.result);
+    hasUnsupported |= res.hasUnsupported;
+  }
+  return verificationResult;
+}
+
 Results validate(
     mlir::OwningOpRef<mlir::ModuleOp> &src,
-    mlir::OwningOpRef<mlir::ModuleOp> &tgt) {
+    mlir::OwningOpRef<mlir::ModuleOp> &tgt, bool &hasUnsupported) {
   map<llvm::StringRef, mlir::func::FuncOp> srcfns, tgtfns;
   auto fillFns = [](map<llvm::StringRef, mlir::func::FuncOp> &m,
                     mlir::Operation &op) {
@@ -756,11 +1608,13 @@ Results validate(
   llvm::for_each(*tgt, [&](auto &op) { fillFns(tgtfns, op); });
 
   Results verificationResult = Results::SUCCESS;
-  bool hasUnsupported = false;
+  hasUnsupported = false;
 
   llvm::StringRef verify_fn_name = llvm::StringRef(arg_verify_fn_name.getValue());
   bool is_check_single_fn = !verify_fn_name.empty();
 
+  // srcfns is sorted by name, so is fnPairs.
+  vector<FnPair> fnPairs;
   for (auto [name, srcfn]: srcfns) {
     if (is_check_single_fn) {
       if (!name.compare(verify_fn_name) == 0) {
@@ -775,99 +1629,85 @@ Results validate(
       continue;
     }
     // TODO: check fn signature
-    auto tgtfn = itr->second;
-
-    AnalysisResult src_res, tgt_res;
-    vector<mlir::memref::GlobalOp> globals;
-
-    Tensor::MAX_TENSOR_SIZE = max_tensor_size.getValue();
-    Tensor::MAX_CONST_SIZE = max_const_tensor_size.getValue();
-    Tensor::MAX_DIM_SIZE = max_unknown_dimsize.getValue();
-    MemRef::MAX_DIM_SIZE = max_unknown_dimsize.getValue();
-
-    try {
-      src_res = analyze(srcfn);
-      tgt_res = analyze(tgtfn);
-      globals = mergeGlobals(
-          src_res.memref.usedGlobals, tgt_res.memref.usedGlobals);
-    } catch (UnsupportedException ue) {
-      printUnsupported(ue);
-      hasUnsupported = true;
-      continue;
-    }
-
-    auto f32_consts = src_res.F32.constSet;
-    f32_consts.merge(tgt_res.F32.constSet);
-    auto f64_consts = src_res.F64.constSet;
-    f64_consts.merge(tgt_res.F64.constSet);
-
-    ValidationInput vinput;
-    vinput.src = srcfn;
-    vinput.tgt = tgtfn;
-    vinput.dumpSMTPath = arg_dump_smt_to.getValue();
-    vinput.globals = globals;
+    fnPairs.emplace_back(srcfn, itr->second);
+  }
 
-    vinput.numBlocksPerType = src_res.memref.argCount;
-    for (auto &[ty, cnt]: src_res.memref.varCount)
-      vinput.numBlocksPerType[ty] += cnt;
-    for (auto &[ty, cnt]: tgt_res.memref.varCount)
-      vinput.numBlocksPerType[ty] += cnt;
+  if (!arg_abstraction_profile.getValue().empty() && !absprofile::isOpen()) {
+    if (!absprofile::open(arg_abstraction_profile.getValue()))
+      tvErrs() << "Cannot read the abstraction profile at "
+               << arg_abstraction_profile.getValue()
+               << "; running without it\n";
+  }
 
-    if (vinput.numBlocksPerType.size() > 1) {
-      llvm::outs() << "NOTE: mlir-tv assumes that memrefs of different element "
-          "types do not alias. This can cause missing bugs.\n";
-    }
+  if (!arg_query_cache.getValue().empty() && !querycache::isOpen()) {
+    if (!querycache::open(arg_query_cache.getValue(),
+                          query_cache_max_entries.getValue()))
+      tvErrs() << "Cannot open the query cache at "
+               << arg_query_cache.getValue() << "; running without it\n";
+  }
 
-    if (num_memblocks.getValue() != 0) {
-      for (auto &[_, cnt]: vinput.numBlocksPerType)
-        cnt = num_memblocks.getValue();
+  if (extsolver::isEnabled() && (arg_parallel_checks.getValue() ||
+      arg_split_memory_checks.getValue() || arg_split_dims.getValue() > 0))
+    tvErrs() << "The queries are checked one by one with --ext-solver\n";
+  // The incremental solver checks every step (see checkRefinement)
+  if (arg_incremental_checks.getValue() && smt::hasZ3StepTactics())
+    tvErrs() << "--z3-tactic pipelines of a step other than * have no effect"
+                " with --incremental-checks\n";
+
+  Tensor::MAX_TENSOR_SIZE = max_tensor_size.getValue();
+  Tensor::MAX_CONST_SIZE = max_const_tensor_size.getValue();
+  Tensor::MAX_DIM_SIZE = max_unknown_dimsize.getValue();
+  MemRef::MAX_DIM_SIZE = max_unknown_dimsize.getValue();
+
+  unsigned numThreads = min((size_t)num_threads.getValue(), fnPairs.size());
+  numFunctionThreads = max(numThreads, 1u);
+  if (numThreads > 1) {
+    verificationResult = validateInParallel(fnPairs, numThreads,
+        hasUnsupported);
+  } else {
+    // The expressions of this module pair are freed with their own context,
+    // unless the current context is kept warm
+    shared_ptr<smt::Context> ctx;
+    optional<smt::ContextScope> scope;
+    if (!reuseSMTContext) {
+      ctx = smt::makeContext(smt::getContextConfig());
+      scope.emplace(*ctx);
     }
+    auto release = llvm::make_scope_exit([]() {
+      releaseThreadLocalExprs();
+      smt::clearNamedTerms();
+    });
+    for (auto &[srcfn, tgtfn]: fnPairs)
+      verificationResult.merge(
+          validateFunction(srcfn, tgtfn, hasUnsupported));
+  }
 
-    if (fp_bits.getValue() != 0) {
-      assert(fp_bits.getValue() < 32 && "Given fp bits are too large");
-      vinput.f32NonConstsCount = vinput.f64NonConstsCount =
-          1u << fp_bits.getValue();
-    } else {
-      // Count non-constant floating points whose absolute values are distinct.
-      auto countNonConstFps = [](const auto& src_res, const auto& tgt_res,
-          bool elemwise) {
-        if (elemwise) {
-          return src_res.argCount + // # of variables in argument lists
-            src_res.varCount + tgt_res.varCount; // # of variables in registers
-        } else {
-          return src_res.argCount + // # of variables in argument lists
-            src_res.varCount + tgt_res.varCount + // # of variables in registers
-            src_res.elemsCount + tgt_res.elemsCount;
-                // # of ShapedType elements count
-        }
-      };
-
-      auto isElementwise = src_res.isElementwiseFPOps ||
-                           tgt_res.isElementwiseFPOps;
-      vinput.f32NonConstsCount =
-          countNonConstFps(src_res.F32, tgt_res.F32, isElementwise);
-      vinput.f64NonConstsCount =
-          countNonConstFps(src_res.F64, tgt_res.F64, isElementwise);
-    }
-    vinput.f32Consts = f32_consts;
-    vinput.f32HasInfOrNaN = src_res.F32.hasInfOrNaN | tgt_res.F32.hasInfOrNaN;
-    vinput.f64Consts = f64_consts;
-    vinput.f64HasInfOrNaN = src_res.F64.hasInfOrNaN | tgt_res.F64.hasInfOrNaN;
-    vinput.isFpAddAssociative = arg_fp_add_associative.getValue();
-    vinput.unrollIntSum = arg_unroll_int_sum.getValue();
-    vinput.useMultisetForFpSum = arg_multiset.getValue();
+  if (querycache::isOpen()) {
+    auto stats = querycache::getStats();
+    tvOuts() << "Query cache: " << stats.hits << " hits, " << stats.misses
+        << " misses, " << stats.stores << " stores, " << stats.evictions
+        << " evictions\n";
+  }
 
-    try {
-      verificationResult.merge(validate(vinput));
-    } catch (UnsupportedException ue) {
-      printUnsupported(ue);
-      hasUnsupported = true;
-    }
+  if (absprofile::isOpen()) {
+    auto stats = absprofile::getStats();
+    tvOuts() << "Abstraction profile: " << stats.hits << " hits, "
+        << stats.stores << " stores, " << stats.invalidated
+        << " invalidated, " << stats.savedIterations
+        << " refinement iterations and " << stats.savedMs
+        << " msec. of solver time saved\n";
   }
 
+  return verificationResult;
+}
+
+Results validate(
+    mlir::OwningOpRef<mlir::ModuleOp> &src,
+    mlir::OwningOpRef<mlir::ModuleOp> &tgt) {
+  bool hasUnsupported;
+  auto verificationResult = validate(src, tgt, hasUnsupported);
   if (hasUnsupported) {
     exit(UNSUPPORTED_EXIT_CODE);
   }
-
   return verificationResult;
 }
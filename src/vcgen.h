@@ -43,5 +43,16 @@ enum class VerificationStep {
   Memory
 };
 
+// By default, each validation of a module pair creates SMT contexts of its
+// own. If reuse is set, a validation on one thread uses the calling thread's
+// current context instead, so that its solvers and caches stay warm across
+// validations (see --serve).
+void setReuseSMTContext(bool reuse);
+
+// Exits with UNSUPPORTED_EXIT_CODE if a function is not supported.
 Results validate(mlir::OwningOpRef<mlir::ModuleOp> &src,
                   mlir::OwningOpRef<mlir::ModuleOp> &tgt);
+// Sets hasUnsupported instead of exiting.
+Results validate(mlir::OwningOpRef<mlir::ModuleOp> &src,
+                  mlir::OwningOpRef<mlir::ModuleOp> &tgt,
+                  bool &hasUnsupported);
@@ -256,13 +256,15 @@ class SrcTgtPairTest(TestFormat):
                 test = MutOnce(InvalidTest())
 
         if not (test.get() == TestKeyword.UNSUPPORTED or test.get() == TestKeyword.INVALID) and idcheck_args.get() is not None:
+            # The syntactic check would skip the solver in the identity checks
+            identity_args: List[str] = idcheck_args.get() + ["--no-syntactic-check"]
             src_identity: Tuple[ResultCode, str] = VerifyTest().check_exit_code(
-                *_executeCommand(self._dir_tv, tc_src, tc_src, idcheck_args.get()))
+                *_executeCommand(self._dir_tv, tc_src, tc_src, identity_args))
             if src_identity[0] != lit.Test.PASS:
                 return src_identity
 
             tgt_identity: Tuple[ResultCode, str] = VerifyTest().check_exit_code(
-                *_executeCommand(self._dir_tv, tc_tgt, tc_tgt, idcheck_args.get()))
+                *_executeCommand(self._dir_tv, tc_tgt, tc_tgt, identity_args))
             if tgt_identity[0] != lit.Test.PASS:
                 return tgt_identity
 
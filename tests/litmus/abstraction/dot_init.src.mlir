@@ -0,0 +1,10 @@
+// EXPECT: "dot ops (fp): SUM_MUL"
+
+func.func @f(%a: tensor<?xf32>, %b: tensor<?xf32>) -> tensor<f32> {
+  %init = arith.constant 1.0 : f32
+  %i = tensor.empty (): tensor<f32>
+  %outty = linalg.fill ins(%init: f32) outs(%i: tensor<f32>) -> tensor<f32>
+  %e = linalg.dot ins(%a, %b : tensor<?xf32>,tensor<?xf32>)
+    outs(%outty: tensor<f32>) -> tensor<f32>
+  return %e : tensor<f32>
+}
@@ -0,0 +1,4 @@
+func.func @f(%x: i64, %y: i64) -> i1 {
+  %false = arith.constant false
+  return %false : i1
+}
@@ -0,0 +1,11 @@
+// EXPECT: "Memory mismatch" && "f.3.memory.f32: check under an assumption after 3 obligations in the same solver"
+// ARGS: --incremental-checks --verbose
+
+// The UB check and both return values hold, so the memory check is the
+// fourth obligation that the solver checks
+func.func @f(%a: memref<2xf32>, %t: tensor<4xf32>, %x: f32) -> (f32, f32) {
+  %c0 = arith.constant 0 : index
+  %v = tensor.extract %t[%c0] : tensor<4xf32>
+  memref.store %x, %a[%c0] : memref<2xf32>
+  return %v, %x : f32, f32
+}
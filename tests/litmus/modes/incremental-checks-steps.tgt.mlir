@@ -0,0 +1,5 @@
+func.func @f(%a: memref<2xf32>, %t: tensor<4xf32>, %x: f32) -> (f32, f32) {
+  %c0 = arith.constant 0 : index
+  %v = tensor.extract %t[%c0] : tensor<4xf32>
+  return %v, %x : f32, f32
+}
@@ -0,0 +1,29 @@
+// VERIFY-INCORRECT
+// ARGS: -j=4
+
+func.func @addi(%x: i32) -> i32 {
+  %c1 = arith.constant 1 : i32
+  %c2 = arith.constant 2 : i32
+  %a = arith.addi %x, %c1 : i32
+  %b = arith.addi %a, %c2 : i32
+  return %b : i32
+}
+
+func.func @retval(%x: i32, %y: i32) -> i32 {
+  %r = arith.addi %x, %y : i32
+  return %r : i32
+}
+
+func.func @memory(%m: memref<8xf32>, %i: index, %v: f32) {
+  memref.store %v, %m[%i] : memref<8xf32>
+  return
+}
+
+func.func @dot(%a: tensor<?xf32>, %b: tensor<?xf32>) -> tensor<f32> {
+  %zero = arith.constant -0.0 : f32
+  %i = tensor.empty () : tensor<f32>
+  %outty = linalg.fill ins(%zero: f32) outs(%i: tensor<f32>) -> tensor<f32>
+  %e = linalg.dot ins(%a, %b : tensor<?xf32>, tensor<?xf32>)
+    outs(%outty: tensor<f32>) -> tensor<f32>
+  return %e : tensor<f32>
+}
@@ -0,0 +1,22 @@
+// EXPECT: "Source is more defined than target" && "f.1.ub is not unsat; later queries interrupted: 1"
+// ARGS: --parallel-checks --verbose
+
+// The return value is the same, but proving it means showing that 2^61-1
+// has no 32-bit factors, which takes far longer than the timeout. The UB
+// check fails first and interrupts it.
+func.func @f(%t: tensor<4xf32>, %i: index, %x: i64, %y: i64) -> i1 {
+  %p = arith.constant 2305843009213693951 : i64
+  %one = arith.constant 1 : i64
+  %lim = arith.constant 4294967296 : i64
+  %xy = arith.muli %x, %y : i64
+  %isp = arith.cmpi eq, %xy, %p : i64
+  %x1 = arith.cmpi ugt, %x, %one : i64
+  %y1 = arith.cmpi ugt, %y, %one : i64
+  %x2 = arith.cmpi ult, %x, %lim : i64
+  %y2 = arith.cmpi ult, %y, %lim : i64
+  %a1 = arith.andi %isp, %x1 : i1
+  %a2 = arith.andi %a1, %y1 : i1
+  %a3 = arith.andi %a2, %x2 : i1
+  %a4 = arith.andi %a3, %y2 : i1
+  return %a4 : i1
+}
@@ -0,0 +1,5 @@
+func.func @f(%t: tensor<4xf32>, %i: index, %x: i64, %y: i64) -> i1 {
+  %v = tensor.extract %t[%i] : tensor<4xf32>
+  %false = arith.constant false
+  return %false : i1
+}
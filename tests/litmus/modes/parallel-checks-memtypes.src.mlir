@@ -0,0 +1,10 @@
+// EXPECT: "Memory mismatch" && "check 3 queries concurrently" && "f.3.memory.i32 is not unsat"
+// ARGS: --parallel-checks --verbose
+
+// The memory of each element type is checked by a query of its own
+func.func @f(%a: memref<2xf32>, %b: memref<2xi32>, %x: f32, %y: i32) {
+  %c0 = arith.constant 0 : index
+  memref.store %x, %a[%c0] : memref<2xf32>
+  memref.store %y, %b[%c0] : memref<2xi32>
+  return
+}
@@ -0,0 +1,7 @@
+func.func @f(%a: memref<2xf32>, %b: memref<2xi32>, %x: f32, %y: i32) {
+  %c0 = arith.constant 0 : index
+  %c1 = arith.constant 1 : index
+  memref.store %x, %a[%c0] : memref<2xf32>
+  memref.store %y, %b[%c1] : memref<2xi32>
+  return
+}
@@ -0,0 +1,18 @@
+// EXPECT: "Return value mismatch"
+// ARGS: -j=3
+
+func.func @f(%v: i32, %w: i32) -> i32 {
+  %x = arith.addi %v, %w: i32
+  return %x: i32
+}
+
+func.func @g(%v: i32) -> i32 {
+  %c2 = arith.constant 2: i32
+  %x = arith.muli %v, %c2: i32
+  return %x: i32
+}
+
+func.func @h(%v: i32, %w: i32) -> i32 {
+  %x = arith.subi %v, %w: i32
+  return %x: i32
+}
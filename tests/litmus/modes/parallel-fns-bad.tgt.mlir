@@ -0,0 +1,14 @@
+func.func @f(%v: i32, %w: i32) -> i32 {
+  %x = arith.addi %w, %v: i32
+  return %x: i32
+}
+
+func.func @g(%v: i32) -> i32 {
+  %x = arith.addi %v, %v: i32
+  return %x: i32
+}
+
+func.func @h(%v: i32, %w: i32) -> i32 {
+  %x = arith.subi %w, %v: i32
+  return %x: i32
+}
@@ -0,0 +1,19 @@
+// VERIFY
+// ARGS: -j=3
+
+func.func @f(%v: i32, %w: i32) -> i32 {
+  %x = arith.addi %v, %w: i32
+  return %x: i32
+}
+
+func.func @g(%v: i32) -> i32 {
+  %c2 = arith.constant 2: i32
+  %x = arith.muli %v, %c2: i32
+  return %x: i32
+}
+
+func.func @h(%a: memref<4xf32>, %v: f32) {
+  %c0 = arith.constant 0: index
+  memref.store %v, %a[%c0]: memref<4xf32>
+  return
+}
@@ -0,0 +1,15 @@
+func.func @f(%v: i32, %w: i32) -> i32 {
+  %x = arith.addi %w, %v: i32
+  return %x: i32
+}
+
+func.func @g(%v: i32) -> i32 {
+  %x = arith.addi %v, %v: i32
+  return %x: i32
+}
+
+func.func @h(%a: memref<4xf32>, %v: f32) {
+  %c0 = arith.constant 0: index
+  memref.store %v, %a[%c0]: memref<4xf32>
+  return
+}
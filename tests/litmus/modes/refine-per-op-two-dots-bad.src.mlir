@@ -0,0 +1,14 @@
+// EXPECT: "Return value mismatch (2/2)"
+// ARGS: --refine-per-op
+
+// The second dot differs under any abstraction
+func.func @f(%a: tensor<?xf32>, %b: tensor<?xf32>, %c: tensor<?xf32>, %d: tensor<?xf32>) -> (tensor<f32>, tensor<f32>) {
+  %zero = arith.constant -0.0 : f32
+  %i = tensor.empty (): tensor<f32>
+  %outty = linalg.fill ins(%zero: f32) outs(%i: tensor<f32>) -> tensor<f32>
+  %e1 = linalg.dot ins(%a, %b : tensor<?xf32>,tensor<?xf32>)
+    outs(%outty: tensor<f32>) -> tensor<f32>
+  %e2 = linalg.dot ins(%c, %d : tensor<?xf32>,tensor<?xf32>)
+    outs(%outty: tensor<f32>) -> tensor<f32>
+  return %e1, %e2 : tensor<f32>, tensor<f32>
+}
@@ -0,0 +1,10 @@
+// EXPECT: "split each query into 64 cubes" && "== Result: correct =="
+// ARGS: --split-dims=3 --verbose --no-syntactic-check
+
+// Splitting the fourth dimension would make 256 cubes, more than
+// MAX_DIM_CUBES, so it stays symbolic
+func.func @f(%t: tensor<?x?x?x?xf32>) -> index {
+  %c3 = arith.constant 3: index
+  %d = tensor.dim %t, %c3: tensor<?x?x?x?xf32>
+  return %d: index
+}
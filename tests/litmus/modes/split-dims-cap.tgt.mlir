@@ -0,0 +1,5 @@
+func.func @f(%t: tensor<?x?x?x?xf32>) -> index {
+  %c3 = arith.constant 3: index
+  %d = tensor.dim %t, %c3: tensor<?x?x?x?xf32>
+  return %d: index
+}
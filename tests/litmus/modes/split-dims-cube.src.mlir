@@ -0,0 +1,10 @@
+// EXPECT: "Return value mismatch" && "split each query into 3 cubes" && "f.2.retval.0.cube1 is not unsat"
+// ARGS: --split-dims=2 --verbose
+
+// The cubes are dim0 = 0, dim0 = 1 and dim0 >= 2. Only the second one has
+// a counterexample.
+func.func @f(%t: tensor<?xf32>) -> index {
+  %c0 = arith.constant 0: index
+  %d = tensor.dim %t, %c0: tensor<?xf32>
+  return %d: index
+}
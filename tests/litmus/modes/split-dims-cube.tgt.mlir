@@ -0,0 +1,9 @@
+func.func @f(%t: tensor<?xf32>) -> index {
+  %c0 = arith.constant 0: index
+  %c1 = arith.constant 1: index
+  %c2 = arith.constant 2: index
+  %d = tensor.dim %t, %c0: tensor<?xf32>
+  %is1 = arith.cmpi eq, %d, %c1: index
+  %r = arith.select %is1, %c2, %d: index
+  return %r: index
+}
@@ -0,0 +1,13 @@
+// EXPECT: "Memory mismatch (block " && "check 4 queries concurrently"
+// ARGS: --split-memory-checks --verbose
+
+// The UB check, the return value and one memory check per block
+
+func.func @test(%a : memref<2xf32>, %b : memref<2xf32>) -> f32
+{
+  %index = arith.constant 1 : index
+  %val = arith.constant 1.000000e-03 : f32
+  memref.store %val, %a[%index] : memref<2xf32>
+  memref.store %val, %b[%index] : memref<2xf32>
+  return %val : f32
+}
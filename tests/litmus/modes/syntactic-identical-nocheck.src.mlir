@@ -0,0 +1,10 @@
+// EXPECT: "== Result: correct =="
+// ARGS: --no-syntactic-check
+
+func.func @f(%arg: tensor<4xf32>, %i: index) -> f32
+{
+  %c = arith.constant 1.0 : f32
+  %v = tensor.extract %arg[%i] : tensor<4xf32>
+  %r = arith.addf %v, %c : f32
+  return %r : f32
+}
@@ -0,0 +1,8 @@
+// EXPECT: "correct (source is always undefined)"
+
+func.func @f(%arg: tensor<4xf32>) -> f32
+{
+  %i = arith.constant 4 : index
+  %v = tensor.extract %arg[%i] : tensor<4xf32>
+  return %v : f32
+}
@@ -0,0 +1,6 @@
+func.func @f(%t: tensor<4xf32>) -> f32
+{
+  %idx = arith.constant 4 : index
+  %x = tensor.extract %t[%idx] : tensor<4xf32>
+  return %x : f32
+}
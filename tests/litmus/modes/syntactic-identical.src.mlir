@@ -0,0 +1,9 @@
+// EXPECT: "correct (syntactically identical)"
+
+func.func @f(%arg: tensor<4xf32>, %i: index) -> f32
+{
+  %c = arith.constant 1.0 : f32
+  %v = tensor.extract %arg[%i] : tensor<4xf32>
+  %r = arith.addf %v, %c : f32
+  return %r : f32
+}
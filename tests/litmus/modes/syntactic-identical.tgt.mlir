@@ -0,0 +1,7 @@
+func.func @f(%t: tensor<4xf32>, %idx: index) -> f32
+{
+  %one = arith.constant 1.0 : f32
+  %x = tensor.extract %t[%idx] : tensor<4xf32>
+  %y = arith.addf %x, %one : f32
+  return %y : f32
+}
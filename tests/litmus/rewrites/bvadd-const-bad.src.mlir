@@ -0,0 +1,9 @@
+// VERIFY-INCORRECT
+
+func.func @f(%x: i32) -> i32 {
+  %c1 = arith.constant 1 : i32
+  %c2 = arith.constant 2 : i32
+  %a = arith.addi %x, %c1 : i32
+  %b = arith.subi %a, %c2 : i32
+  return %b : i32
+}
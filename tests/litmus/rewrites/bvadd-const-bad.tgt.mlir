@@ -0,0 +1,5 @@
+func.func @f(%x: i32) -> i32 {
+  %c1 = arith.constant 1 : i32
+  %b = arith.addi %x, %c1 : i32
+  return %b : i32
+}
@@ -0,0 +1,10 @@
+// VERIFY
+
+func.func @f(%t: tensor<?xf32>, %i: index) -> f32 {
+  %c1 = arith.constant 1 : index
+  %c2 = arith.constant 2 : index
+  %a = arith.addi %i, %c1 : index
+  %b = arith.addi %a, %c2 : index
+  %e = tensor.extract %t[%b] : tensor<?xf32>
+  return %e : f32
+}
@@ -0,0 +1,6 @@
+func.func @f(%t: tensor<?xf32>, %i: index) -> f32 {
+  %c3 = arith.constant 3 : index
+  %b = arith.addi %i, %c3 : index
+  %e = tensor.extract %t[%b] : tensor<?xf32>
+  return %e : f32
+}
@@ -0,0 +1,11 @@
+// VERIFY
+
+func.func @f(%x: i32, %y: i32) -> (i32, i32) {
+  %c1 = arith.constant 1 : i32
+  %c2 = arith.constant 2 : i32
+  %a = arith.addi %x, %c1 : i32
+  %b = arith.addi %a, %c2 : i32
+  %d = arith.subi %x, %x : i32
+  %e = arith.addi %d, %y : i32
+  return %b, %e : i32, i32
+}
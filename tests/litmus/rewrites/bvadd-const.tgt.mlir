@@ -0,0 +1,5 @@
+func.func @f(%x: i32, %y: i32) -> (i32, i32) {
+  %c3 = arith.constant 3 : i32
+  %b = arith.addi %x, %c3 : i32
+  return %b, %y : i32, i32
+}
@@ -0,0 +1,13 @@
+// VERIFY
+
+func.func @f(%a: tensor<8xf32>) -> tensor<8xf32> {
+  %i = tensor.empty () : tensor<8xf32>
+  %r = linalg.generic {
+      indexing_maps = [affine_map<(d0) -> (d0)>, affine_map<(d0) -> (d0)>],
+      iterator_types = ["parallel"]}
+     ins(%a : tensor<8xf32>) outs(%i : tensor<8xf32>) {
+     ^bb0(%x : f32, %o : f32):
+    linalg.yield %x : f32
+  } -> tensor<8xf32>
+  return %r : tensor<8xf32>
+}
@@ -0,0 +1,3 @@
+func.func @f(%a: tensor<8xf32>) -> tensor<8xf32> {
+  return %a : tensor<8xf32>
+}
@@ -0,0 +1,7 @@
+// VERIFY-INCORRECT
+
+func.func @f(%c: i1, %x: i32, %y: i32, %z: i32) -> i32 {
+  %t = arith.select %c, %x, %y : i32
+  %r = arith.select %c, %t, %z : i32
+  return %r : i32
+}
@@ -0,0 +1,4 @@
+func.func @f(%c: i1, %x: i32, %y: i32, %z: i32) -> i32 {
+  %r = arith.select %c, %y, %z : i32
+  return %r : i32
+}
@@ -0,0 +1,6 @@
+// VERIFY
+
+func.func @f(%c: i1, %x: i32) -> i32 {
+  %r = arith.select %c, %x, %x : i32
+  return %r : i32
+}
@@ -0,0 +1,3 @@
+func.func @f(%c: i1, %x: i32) -> i32 {
+  return %x : i32
+}
@@ -0,0 +1,7 @@
+// VERIFY
+
+func.func @f(%x: f32, %y: f32, %i: index) -> f32 {
+  %t = tensor.from_elements %x, %y : tensor<2xf32>
+  %e = tensor.extract %t[%i] : tensor<2xf32>
+  return %e : f32
+}
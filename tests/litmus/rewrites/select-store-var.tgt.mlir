@@ -0,0 +1,6 @@
+func.func @f(%x: f32, %y: f32, %i: index) -> f32 {
+  %c0 = arith.constant 0 : index
+  %c = arith.cmpi eq, %i, %c0 : index
+  %e = arith.select %c, %x, %y : f32
+  return %e : f32
+}
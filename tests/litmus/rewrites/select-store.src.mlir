@@ -0,0 +1,8 @@
+// VERIFY
+
+func.func @f(%x: f32, %y: f32, %z: f32) -> f32 {
+  %c1 = arith.constant 1 : index
+  %t = tensor.from_elements %x, %y, %z : tensor<3xf32>
+  %e = tensor.extract %t[%c1] : tensor<3xf32>
+  return %e : f32
+}
@@ -0,0 +1,7 @@
+// VERIFY
+
+func.func @f(%m: memref<8xf32>, %i: index, %a: f32, %b: f32) {
+  memref.store %a, %m[%i] : memref<8xf32>
+  memref.store %b, %m[%i] : memref<8xf32>
+  return
+}
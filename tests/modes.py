@@ -0,0 +1,656 @@
+"""Tests of the modes of mlir-tv that do not take a single src/tgt pair.
+
+Usage: modes.py <mode> <path to mlir-tv> <path to tests/> [mlir-tv-replay]
+Each mode must give the same exit codes as validating its pairs one by one.
+"""
+import json
+import os
+import re
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from typing import List, Optional, Tuple
+
+
+def _run(command: List[str]) -> Tuple[int, str, str]:
+    proc = subprocess.run(command, stdout=subprocess.PIPE,
+                          stderr=subprocess.PIPE, encoding="utf-8")
+    return proc.returncode, proc.stdout, proc.stderr
+
+
+def _pair(tests_dir: str, name: str) -> Tuple[str, str]:
+    base = os.path.join(tests_dir, "litmus", name)
+    return base + ".src.mlir", base + ".tgt.mlir"
+
+
+# (litmus test, options of the pair)
+_PAIRS: List[Tuple[str, List[str]]] = [
+    ("arith-ops/addi", []),
+    ("modes/parallel-checks-memtypes", ["--parallel-checks"]),
+    ("refinement/memory_mismatch", ["-smt-to=20000"]),
+    ("modes/incremental-checks-steps", ["--incremental-checks"]),
+]
+
+
+def test_batch(tv: str, tests_dir: str) -> List[str]:
+    errors: List[str] = []
+    with tempfile.TemporaryDirectory() as tmp:
+        lines: List[str] = ["# a comment", ""]
+        expected: List[int] = []
+        for name, args in _PAIRS:
+            src, tgt = _pair(tests_dir, name)
+            lines.append(" ".join([src, tgt] + args))
+            expected.append(_run([tv, src, tgt] + args)[0])
+
+        # Options that the batch cannot apply per pair must not be ignored
+        src, tgt = _pair(tests_dir, "arith-ops/addi")
+        lines.append(f"{src} {tgt} --stats-json={tmp}/other.json")
+        lines.append(f"{src} {tgt} --z3-tactic=*:*=no-such-tactic")
+        # The options of the pairs above must not leak into this one
+        lines.append(f"{src} {tgt}")
+        expected.append(0)
+
+        manifest = os.path.join(tmp, "pairs.txt")
+        with open(manifest, "w") as f:
+            f.write("\n".join(lines) + "\n")
+
+        code, outs, errs = _run([tv, f"--batch={manifest}"])
+        results = [int(line.split(":")[1]) for line in outs.splitlines()
+                   if line.startswith("### exit code:")]
+        if results != expected:
+            errors.append(f"batch exit codes {results} != {expected}")
+        if code != max(expected + [1]):
+            errors.append(f"batch exited with {code}")
+        for msg in ["--stats-json cannot be changed", "Invalid --z3-tactic"]:
+            if msg not in errs:
+                errors.append(f"batch did not report '{msg}'")
+        if errors:
+            errors.append(f"stdout >>\n{outs}\nstderr >>\n{errs}")
+    return errors
+
+
+def _request(path: str, body: bytes) -> str:
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+        s.connect(path)
+        s.sendall(body)
+        s.shutdown(socket.SHUT_WR)
+        chunks: List[bytes] = []
+        while True:
+            chunk = s.recv(4096)
+            if not chunk:
+                break
+            chunks.append(chunk)
+    return b"".join(chunks).decode("utf-8")
+
+
+def _exit_code(response: str) -> Optional[int]:
+    first = response.split("\n", 1)[0]
+    if not first.startswith("exit-code "):
+        return None
+    return int(first.split(" ")[1])
+
+
+def test_serve(tv: str, tests_dir: str) -> List[str]:
+    errors: List[str] = []
+    with tempfile.TemporaryDirectory() as tmp:
+        # A file that is not a socket must be left alone
+        path = os.path.join(tmp, "not-a-socket")
+        with open(path, "w") as f:
+            f.write("data")
+        code, _, _ = _run([tv, f"--serve={path}"])
+        if code == 0 or not os.path.isfile(path):
+            errors.append("--serve replaced a file that is not a socket")
+
+        path = os.path.join(tmp, "tv.sock")
+        server = subprocess.Popen(
+            [tv, f"--serve={path}", "--serve-workers=3",
+             "--serve-timeout=2000"],
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        for _ in range(1000):
+            if os.path.exists(path):
+                break
+            time.sleep(0.01)
+
+        # A client that sends nothing must not block the others
+        idle = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        idle.connect(path)
+
+        expected: List[int] = []
+        bodies: List[bytes] = []
+        for name, args in _PAIRS:
+            src, tgt = _pair(tests_dir, name)
+            expected.append(_run([tv, src, tgt] + args)[0])
+            lines = [f"arg {arg}" for arg in args]
+            lines += [f"src-path {src}", f"tgt-path {tgt}", "end"]
+            bodies.append(("\n".join(lines) + "\n").encode("utf-8"))
+
+        results: List[Optional[int]] = [None] * len(bodies)
+
+        def send(i: int) -> None:
+            results[i] = _exit_code(_request(path, bodies[i]))
+
+        threads = [threading.Thread(target=send, args=(i,))
+                   for i in range(len(bodies))]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        if results != expected:
+            errors.append(f"serve exit codes {results} != {expected}")
+
+        idle.settimeout(30)
+        response = idle.recv(4096).decode("utf-8")
+        idle.close()
+        if "Timed out" not in response:
+            errors.append(f"idle connection got {response!r}")
+
+        _request(path, b"shutdown\n")
+        if server.wait(60) != 0:
+            errors.append(f"serve exited with {server.returncode}")
+        if os.path.exists(path):
+            errors.append("serve did not remove its socket")
+    return errors
+
+
+def test_portfolio(tv: str, tests_dir: str) -> List[str]:
+    errors: List[str] = []
+    for name, args in _PAIRS:
+        src, tgt = _pair(tests_dir, name)
+        code, outs, errs = _run([tv, src, tgt, "--solver=portfolio",
+                                 "--verbose"] + args)
+        if "must be set" in errs:
+            # mlir-tv was not built with both solvers
+            return []
+        expected = _run([tv, src, tgt] + args)[0]
+        if code != expected:
+            errors.append(f"{name}: portfolio exited with {code} != {expected}")
+        if not any(f"answered by {s} in " in outs for s in ["Z3", "cvc5"]):
+            errors.append(f"{name}: no winner was reported\n{outs}")
+    return errors
+
+
+def _cache_stats(outs: str) -> Optional[Tuple[int, int, int, int]]:
+    m = re.search(r"Query cache: (\d+) hits, (\d+) misses, (\d+) stores, "
+                  r"(\d+) evictions", outs)
+    if not m:
+        return None
+    hits, misses, stores, evictions = (int(g) for g in m.groups())
+    return hits, misses, stores, evictions
+
+
+def test_cache(tv: str, tests_dir: str) -> List[str]:
+    errors: List[str] = []
+    correct = _pair(tests_dir, "arith-ops/addi")
+    # Its memory query is sat
+    incorrect = _pair(tests_dir, "refinement/memory_mismatch")
+    with tempfile.TemporaryDirectory() as tmp:
+        cache = f"--query-cache={tmp}/cache"
+
+        def run(pair: Tuple[str, str], args: List[str]):
+            code, outs, errs = _run([tv, *pair, cache] + args)
+            return code, _cache_stats(outs), outs + errs
+
+        # (pair, options, expected hits, misses and stores). None is any
+        # positive number.
+        steps = [
+            # A new query is a miss and is stored
+            (correct, [], 0, None, None),
+            # The same queries are answered by the cache
+            (correct, [], None, 0, 0),
+            (incorrect, [], 0, None, None),
+            # A sat answer cannot print a counterexample, so it is solved
+            # again, but the unsat answers are used
+            (incorrect, [], None, None, None),
+            # With --succinct, the sat answer is used as well
+            (incorrect, ["--succinct"], None, 0, 0),
+        ]
+        codes = {}
+        for pair, args, *expected in steps:
+            code, stats, output = run(pair, args)
+            name = f"{os.path.basename(pair[0])} {args}"
+            if codes.setdefault(pair, code) != code:
+                errors.append(f"{name}: exit code {code} != {codes[pair]}")
+            if stats is None:
+                errors.append(f"{name}: no cache stats\n{output}")
+                continue
+            for what, n, want in zip(["hits", "misses", "stores"], stats,
+                                     expected):
+                if (n > 0) if want is None else (n == want):
+                    continue
+                errors.append(f"{name}: {n} {what}, expected "
+                              f"{'some' if want is None else want}")
+
+        # Only the most recently used entry is left
+        _, stats, output = run(incorrect, ["--query-cache-max-entries=1",
+                                           "--succinct", "-smt-to=20000",
+                                           f"--query-cache={tmp}/small"])
+        entries = [f for f in os.listdir(f"{tmp}/small")
+                   if f.endswith(".smtres")]
+        if stats is None or stats[3] == 0 or len(entries) > 1:
+            errors.append(f"eviction left {len(entries)} entries\n{output}")
+    return errors
+
+
+def _profile_stats(outs: str) -> Optional[Tuple[int, int, int]]:
+    m = re.search(r"Abstraction profile: (\d+) hits, (\d+) stores, "
+                  r"(\d+) invalidated", outs)
+    if not m:
+        return None
+    hits, stores, invalidated = (int(g) for g in m.groups())
+    return hits, stores, invalidated
+
+
+def test_profile(tv: str, tests_dir: str) -> List[str]:
+    errors: List[str] = []
+    # It is validated after the fp dot abstraction is refined
+    refined = _pair(tests_dir, "abstraction/dot")
+    # It is validated at the most abstract abstraction
+    abstract = _pair(tests_dir, "arith-ops/addi")
+    with tempfile.TemporaryDirectory() as tmp:
+        def run(pair: Tuple[str, str], args: List[str]):
+            code, outs, errs = _run([tv, *pair,
+                                     f"--abstraction-profile={tmp}/p"] + args)
+            return code, _profile_stats(outs), outs + errs
+
+        # (pair, options, expected hits, stores and invalidated entries)
+        steps = [
+            # A miss: the refined abstraction is stored
+            (refined, [], 0, 1, 0),
+            # A hit starts at the stored abstraction, so nothing is stored
+            (refined, [], 1, 0, 0),
+            # A function of another shape misses, and one that is validated
+            # without a refinement is not stored
+            (abstract, [], 0, 0, 0),
+            # The profile is not used with --refine-per-op
+            (refined, ["--refine-per-op"], 0, 0, 0),
+        ]
+        codes = {}
+        for pair, args, *expected in steps:
+            code, stats, output = run(pair, args)
+            name = f"{os.path.basename(pair[0])} {args}"
+            if codes.setdefault(pair, code) != code:
+                errors.append(f"{name}: exit code {code} != {codes[pair]}")
+            if stats is None:
+                errors.append(f"{name}: no profile stats\n{output}")
+                continue
+            if list(stats) != expected:
+                errors.append(f"{name}: (hits, stores, invalidated) {stats} "
+                              f"!= {tuple(expected)}\n{output}")
+            hit = "Starting at the abstraction in the profile" in output
+            if hit != (expected[0] > 0):
+                errors.append(f"{name}: the start message does not match "
+                              f"the hits\n{output}")
+
+        # A hit whose start times out is invalidated, and the validation
+        # starts over at the most abstract abstraction. Whether a query times
+        # out in 1 msec. depends on the machine, so check the run that it
+        # did. The entry is gone unless the run stored it again.
+        _, stats, output = run(refined, ["-smt-to=1"])
+        timed_out = "The abstraction in the profile timed out" in output
+        if stats is None or stats[0] != 1 or stats[2] != int(timed_out):
+            errors.append(f"-smt-to=1: (hits, stores, invalidated) {stats}, "
+                          f"{'' if timed_out else 'no '}timeout at the start"
+                          f"\n{output}")
+        if timed_out and stats is not None and stats[1] == 0:
+            _, stats, output = run(refined, [])
+            if stats is None or stats[0] != 0:
+                errors.append(f"the invalidated entry was used\n{output}")
+    return errors
+
+
+def test_lazy(tv: str, tests_dir: str) -> List[str]:
+    errors: List[str] = []
+    # Pairs whose abstraction is refined from a fully abstract dot
+    for name in ["abstraction/dot", "abstraction/dot_init",
+                 "modes/refine-per-op-two-dots"]:
+        src, tgt = _pair(tests_dir, name)
+        lazy = _run([tv, src, tgt, "--verbose"])
+        eager = _run([tv, src, tgt, "--verbose", "--no-lazy-encoding"])
+        if lazy[0] != eager[0]:
+            errors.append(f"{name}: lazy encoding exited with {lazy[0]}, "
+                          f"eager encoding with {eager[0]}")
+        if "refined abstraction" not in lazy[1]:
+            errors.append(f"{name}: the abstraction was not refined\n"
+                          f"{lazy[1]}")
+        elif "reuse the encoding" not in lazy[1]:
+            errors.append(f"{name}: the encoding was not reused\n{lazy[1]}")
+        if "reuse the encoding" in eager[1]:
+            errors.append(f"{name}: --no-lazy-encoding reused the encoding")
+    return errors
+
+
+def _check_type(errors: List[str], where: str, obj: dict, key: str,
+                types) -> bool:
+    if not isinstance(obj.get(key), types):
+        errors.append(f"{where}: '{key}' is {obj.get(key)!r}")
+        return False
+    return True
+
+
+def _check_times(errors: List[str], where: str, obj: dict) -> None:
+    if _check_type(errors, where, obj, "times_ms", dict):
+        for phase, ms in obj["times_ms"].items():
+            if not isinstance(ms, (int, float)) or ms < 0:
+                errors.append(f"{where}: time of {phase} is {ms!r}")
+
+
+def test_stats(tv: str, tests_dir: str) -> List[str]:
+    errors: List[str] = []
+    # (pair, expected result, whether the abstraction is refined)
+    pairs = [("arith-ops/addi", "SUCCESS", False),
+             ("abstraction/dot", "SUCCESS", True),
+             ("refinement/memory_mismatch", None, False)]
+    with tempfile.TemporaryDirectory() as tmp:
+        for name, expected, refined in pairs:
+            src, tgt = _pair(tests_dir, name)
+            path = os.path.join(tmp, "stats.json")
+            code, outs, errs = _run([tv, src, tgt, f"--stats-json={path}"])
+            try:
+                with open(path) as f:
+                    stats = json.load(f)
+            except (OSError, ValueError) as e:
+                errors.append(f"{name}: {e}\n{outs}{errs}")
+                continue
+
+            _check_type(errors, name, stats, "peak_rss_kb", int)
+            _check_times(errors, name, stats)
+            if "parse" not in stats.get("times_ms", {}):
+                errors.append(f"{name}: no parse time")
+            if not _check_type(errors, name, stats, "functions", list):
+                continue
+            for fn in stats["functions"]:
+                where = f"{name}: {fn.get('name')}"
+                _check_type(errors, where, fn, "name", str)
+                _check_times(errors, where, fn)
+                if (fn.get("result") == "SUCCESS") != (code == 0):
+                    errors.append(f"{where}: result {fn.get('result')!r}, "
+                                  f"exit code {code}")
+                if expected and fn.get("result") != expected:
+                    errors.append(f"{where}: result {fn.get('result')!r}")
+                for phase in ["total", "simplify"]:
+                    if phase not in fn.get("times_ms", {}):
+                        errors.append(f"{where}: no {phase} time")
+                if not _check_type(errors, where, fn, "iterations", list):
+                    continue
+                if not fn["iterations"]:
+                    errors.append(f"{where}: no iterations")
+                if refined and len(fn["iterations"]) < 2:
+                    errors.append(f"{where}: the abstraction was not refined")
+                for i, itr in enumerate(fn["iterations"]):
+                    at = f"{where}: iteration {i}"
+                    if _check_type(errors, at, itr, "abstraction", dict):
+                        for op, level in itr["abstraction"].items():
+                            if not isinstance(level, str):
+                                errors.append(f"{at}: {op} is {level!r}")
+                    _check_type(errors, at, itr, "reused_encoding", bool)
+                    if i == 0 and itr.get("reused_encoding"):
+                        errors.append(f"{at}: reused an encoding")
+                    _check_times(errors, at, itr)
+                    if not _check_type(errors, at, itr, "queries", list):
+                        continue
+                    for q in itr["queries"]:
+                        qat = f"{at}: {q.get('name')}"
+                        for key, types in [("name", str), ("logic", str),
+                                           ("term_size", int),
+                                           ("cached", bool)]:
+                            _check_type(errors, qat, q, key, types)
+                        if q.get("result") not in ["sat", "unsat",
+                                                   "unknown"]:
+                            errors.append(f"{qat}: result {q.get('result')}")
+                        if "solve_ms" in q:
+                            _check_type(errors, qat, q, "solve_ms",
+                                        (int, float))
+                        if "resource_units" in q and _check_type(
+                                errors, qat, q, "resource_units", dict):
+                            for solver, units in q["resource_units"].items():
+                                if not isinstance(units, int):
+                                    errors.append(f"{qat}: {solver} used "
+                                                  f"{units!r} units")
+            os.remove(path)
+    return errors
+
+
+def _normalize(output: str) -> str:
+    # The solver time varies from run to run
+    return re.sub(r"solver's running time: \d+ msec\.",
+                  "solver's running time: N msec.", output)
+
+
+def test_jobs(tv: str, tests_dir: str) -> List[str]:
+    errors: List[str] = []
+    # Each function of the pair is validated on its own thread and SMT
+    # context. The output must not depend on it.
+    src, tgt = _pair(tests_dir, "modes/jobs-functions")
+    serial = _run([tv, src, tgt, "-j=1"])
+    for _ in range(3):
+        parallel = _run([tv, src, tgt, "-j=4"])
+        if parallel[0] != serial[0]:
+            errors.append(f"-j=4 exited with {parallel[0]} != {serial[0]}")
+        for i, stream in [(1, "stdout"), (2, "stderr")]:
+            if _normalize(parallel[i]) != _normalize(serial[i]):
+                errors.append(f"-j=4 printed a different {stream}\n"
+                              f"-j=1 >>\n{serial[i]}\n"
+                              f"-j=4 >>\n{parallel[i]}")
+        if errors:
+            break
+    return errors
+
+
+def test_replay(tv: str, tests_dir: str, replay: str) -> List[str]:
+    errors: List[str] = []
+    with tempfile.TemporaryDirectory() as tmp:
+        answers = {}
+        for name in ["arith-ops/addi", "refinement/memory_mismatch"]:
+            src, tgt = _pair(tests_dir, name)
+            prefix = os.path.join(tmp, os.path.basename(name))
+            stats = os.path.join(tmp, "stats.json")
+            _run([tv, src, tgt, f"--dump-smt-to={prefix}",
+                  f"--stats-json={stats}"])
+            with open(stats) as f:
+                for fn in json.load(f)["functions"]:
+                    for itr in fn["iterations"]:
+                        for q in itr["queries"]:
+                            answers[(prefix, q["name"])] = q["result"]
+
+        code, outs, errs = _run([replay, tmp, "--format=json"])
+        if code != 0:
+            return [f"mlir-tv-replay exited with {code}\n{errs}"]
+        runs = json.loads(outs)
+        if not runs:
+            errors.append("mlir-tv-replay ran no queries")
+        for run in runs:
+            # <prefix>.<solver>.<query>.smt2
+            m = re.fullmatch(r"(.*)\.(z3|cvc5)\.(.*)\.smt2", run["file"])
+            expected = answers.get((m.group(1), m.group(3))) if m else None
+            if expected is None:
+                errors.append(f"mlir-tv did not answer {run['file']}")
+            elif run["result"] != expected:
+                errors.append(f"{run['file']}: {run['config']} answered "
+                              f"{run['result']}, mlir-tv {expected}")
+            if run["solve_ms"] < 0:
+                errors.append(f"{run['file']}: solve time {run['solve_ms']}")
+        if "sat" not in [run["result"] for run in runs]:
+            errors.append("no sat query was replayed")
+    return errors
+
+
+def test_rlimit(tv: str, tests_dir: str) -> List[str]:
+    errors: List[str] = []
+    # (pair, options, a line of the output). The last one runs out of
+    # resource units.
+    for name, args, expected in [
+            ("arith-ops/addi", [], "== Result: correct =="),
+            ("refinement/memory_mismatch", [], None),
+            ("modes/ext-solver-hard", ["-smt-to=1000"],
+             "== Result: timeout ==")]:
+        src, tgt = _pair(tests_dir, name)
+        runs = []
+        for _ in range(2):
+            code, outs, errs = _run([tv, src, tgt, "--smt-rlimit",
+                                     "--verbose"] + args)
+            if "--smt-rlimit needs" in errs:
+                # mlir-tv only has cvc5, whose units must be measured
+                return []
+            # The results and the units of each query, not the times
+            lines = [line for line in outs.splitlines()
+                     if line.startswith("== Result:") or
+                     line.endswith(" resource units")]
+            runs.append((code, lines))
+        if runs[0] != runs[1]:
+            errors.append(f"{name}: two runs differ\n{runs[0]}\n{runs[1]}")
+        if not any(line.endswith(" resource units") for line in runs[0][1]):
+            errors.append(f"{name}: no resource units were reported")
+        if expected and expected not in runs[0][1]:
+            errors.append(f"{name}: '{expected}' was not printed")
+    return errors
+
+
+def test_z3_tactic(tv: str, tests_dir: str) -> List[str]:
+    errors: List[str] = []
+    src, tgt = _pair(tests_dir, "arith-ops/addi")
+    code, outs, errs = _run([tv, src, tgt, "--verbose"])
+    if code != 0:
+        return [f"addi exited with {code}\n{errs}"]
+    logics = [re.search(rf"\[{fn}\]: use logic: (\S+)", outs)
+              for fn in ["checkRefinement", "checkIsSrcAlwaysUB"]]
+    if not all(logics):
+        return [f"no logic was printed\n{outs}"]
+    logic, notub_logic = (m.group(1) for m in logics)
+
+    # 'skip' leaves a query undecided, so the steps that it is used for time
+    # out. (tactics, expected result, '<logic>:<step>: <pipeline>' that must
+    # be used; none may be used if it is empty)
+    cases = [
+        ([f"{logic}:retval=skip"], "timeout", [f"{logic}:retval: skip"]),
+        (["*:retval=skip"], "timeout", [f"{logic}:retval: skip"]),
+        (["NO_SUCH_LOGIC:*=skip"], "correct", []),
+        # The last matching pipeline is used
+        (["*:*=skip", "*:*=simplify+smt"], "correct",
+         [f"{logic}:retval: simplify+smt"]),
+        (["*:*=simplify+smt", "*:notub=skip"], "correct",
+         [f"{logic}:retval: simplify+smt", f"{notub_logic}:notub: skip"]),
+    ]
+    for tactics, result, pipelines in cases:
+        args = [f"--z3-tactic={t}" for t in tactics]
+        _, outs, errs = _run([tv, src, tgt, "--verbose"] + args)
+        if "Z3 is not enabled" in errs:
+            return []
+        used = re.findall(r"\[Solver\]: Z3 tactic for (.*)", outs)
+        if f"== Result: {result} ==" not in outs:
+            errors.append(f"{tactics}: the result is not {result}\n{outs}")
+        if (not pipelines and used) or \
+                any(p not in used for p in pipelines):
+            errors.append(f"{tactics}: used {used}, expected {pipelines}")
+    return errors
+
+
+# Stubs of --ext-solver. Each one saves its query to the directory in
+# $STUB_DIR and answers the query of the hard return value (the only one with
+# a multiplication) as the file name says.
+_STUBS = {
+    "unsat.sh": "echo unsat",
+    "sat.sh": "echo sat; echo '(model (define-fun x () (_ BitVec 64) "
+              "#x0000000000000003))'",
+    "slow.sh": "sleep 60; echo unsat",
+}
+
+
+def test_ext_solver(tv: str, tests_dir: str) -> List[str]:
+    errors: List[str] = []
+    src, tgt = _pair(tests_dir, "modes/ext-solver-hard")
+    with tempfile.TemporaryDirectory() as tmp:
+        for name, answer in _STUBS.items():
+            stub = os.path.join(tmp, name)
+            with open(stub, "w") as f:
+                f.write("#!/bin/sh\n"
+                        "query=$(cat)\n"
+                        "echo \"$query\" > \"$STUB_DIR/query.$$.smt2\"\n"
+                        "case \"$query\" in\n"
+                        f"  *bvmul*) {answer} ;;\n"
+                        "  *) echo unknown ;;\n"
+                        "esac\n")
+            os.chmod(stub, 0o755)
+
+        # (stub, expected messages)
+        cases = [
+            ("unsat.sh", ["== Result: correct ==", "answered by unsat.sh"]),
+            ("sat.sh", ["Return value mismatch", "<Model from sat.sh>",
+                        "#x0000000000000003"]),
+            # It is killed at the time limit
+            ("slow.sh", ["== Result: timeout =="]),
+        ]
+        for name, expected in cases:
+            queries = os.path.join(tmp, name + ".queries")
+            os.mkdir(queries)
+            os.environ["STUB_DIR"] = queries
+            start = time.monotonic()
+            _, outs, errs = _run([tv, src, tgt, "-smt-to=2000", "--verbose",
+                                  f"--ext-solver={os.path.join(tmp, name)}"])
+            elapsed = time.monotonic() - start
+            for msg in expected:
+                if msg not in outs:
+                    errors.append(f"{name}: '{msg}' was not printed\n"
+                                  f"stdout >>\n{outs}\nstderr >>\n{errs}")
+            if elapsed > 30:
+                errors.append(f"{name}: the validation took {elapsed:.0f}s")
+
+            scripts = []
+            for query in os.listdir(queries):
+                with open(os.path.join(queries, query)) as f:
+                    scripts.append(f.read())
+            if not any("bvmul" in q for q in scripts):
+                errors.append(f"{name}: the hard query was not given")
+            for q in scripts:
+                if "(check-sat)" not in q or "(get-model)" not in q:
+                    errors.append(f"{name}: the query is not a script\n{q}")
+    return errors
+
+
+def _expects(src: str) -> List[str]:
+    with open(src) as f:
+        for line in f:
+            if line.startswith("// EXPECT:"):
+                return re.findall(r'"([^"]*)"', line)
+    return []
+
+
+def test_cvc5(tv: str, tests_dir: str) -> List[str]:
+    errors: List[str] = []
+    # Their counterexamples only need the values of the query's constants
+    for name in ["cexprint/fp", "cexprint/reverse"]:
+        src, tgt = _pair(tests_dir, name)
+        code, outs, errs = _run([tv, src, tgt, "--solver=cvc5", "--verbose"])
+        if "USE_cvc5 was not set" in errs:
+            return []
+        num_errors = len(errors)
+        for expected in _expects(src):
+            if expected not in outs + errs:
+                errors.append(f"{name}: '{expected}' was not printed")
+        if "read the cvc5 values of " not in outs:
+            errors.append(f"{name}: the model was not read at once")
+        if "solve the query again" in outs:
+            errors.append(f"{name}: cvc5 solved the query again to print "
+                          "the counterexample")
+        if code != _run([tv, src, tgt])[0]:
+            errors.append(f"{name}: cvc5 exited with {code}")
+        if len(errors) > num_errors:
+            errors.append(f"stdout >>\n{outs}\nstderr >>\n{errs}")
+    return errors
+
+
+if __name__ == "__main__":
+    mode, tv, tests_dir, *rest = sys.argv[1:]
+    errors = {"batch": test_batch, "serve": test_serve,
+              "portfolio": test_portfolio, "cache": test_cache,
+              "profile": test_profile,
+              "lazy": test_lazy, "stats": test_stats,
+              "cvc5": test_cvc5, "jobs": test_jobs,
+              "ext-solver": test_ext_solver, "rlimit": test_rlimit,
+              "z3-tactic": test_z3_tactic,
+              "replay": test_replay}[mode](tv, tests_dir, *rest)
+    for error in errors:
+        print(error)
+    sys.exit(1 if errors else 0)